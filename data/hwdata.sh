@@ -1,8 +1,8 @@
 #!/bin/sh
 
-while read -r id vendor; do
+# sorted by id in byte order, first entry wins on duplicates: hwdata.hpp binary searches the ids
+LC_ALL=C sort -s -u -k1,1 | while read -r id vendor; do
 	[ "${#id}" = 3 ] || exit 1
 
 	printf "\t__AQ_PNP_PROP(\"%s\", \"%s\"),\n" "$id" "$vendor"
 done
-
@@ -57,6 +57,8 @@ namespace Aquamarine {
         Hyprutils::Memory::CSharedPointer<IAllocator>           allocator;
         Hyprutils::Memory::CWeakPointer<IBackendImplementation> backendImpl;
         std::vector<Hyprutils::Memory::CSharedPointer<IBuffer>> buffers;
+        std::vector<uint64_t>                                   acquiredAt; // per buffer, value of acquireCount when last handed out. 0 means never
+        uint64_t                                                acquireCount = 0;
         int                                                     lastAcquired = 0;
 
         friend class CGBMBuffer;
@@ -8,14 +8,21 @@
 #include <wayland-client.h>
 #include <xf86drmMode.h>
 #include <optional>
+#include <array>
+#include <deque>
+#include <unordered_map>
 
 namespace Aquamarine {
     class CDRMBackend;
     class CDRMFB;
     class CDRMOutput;
     struct SDRMConnector;
+    struct SDRMConnectorCommitData;
     class CDRMRenderer;
     class CDRMDumbAllocator;
+    class CDRMBlobCache;
+    class CDRMFBCache;
+    class CDRMReadback;
 
     typedef std::function<void(void)> FIdleCallback;
 
@@ -90,6 +97,7 @@ namespace Aquamarine {
         CDRMFB(Hyprutils::Memory::CSharedPointer<IBuffer> buffer_, Hyprutils::Memory::CWeakPointer<CDRMBackend> backend_);
         uint32_t submitBuffer();
         void     import();
+        bool     importHandles(const SDMABUFAttrs& attrs);
 
         bool     dropped = false, handlesClosed = false;
 
@@ -107,10 +115,16 @@ namespace Aquamarine {
 
     struct SDRMPlane {
         bool                                         init(drmModePlane* plane);
+        bool                                         supportsFormat(uint32_t drmFormat, uint64_t modifier) const;
 
-        uint64_t                                     type      = 0;
-        uint32_t                                     id        = 0;
-        uint32_t                                     initialID = 0;
+        uint64_t                                     type          = 0;
+        uint32_t                                     id            = 0;
+        uint32_t                                     initialID     = 0;
+        uint32_t                                     possibleCrtcs = 0;
+        uint64_t                                     zpos          = 0; // initial value, planes without the prop keep their id order
+        bool                                         zposMutable   = false;
+        uint64_t                                     zposMin = 0, zposMax = 0;
+        uint32_t                                     overlayCrtc   = 0; // overlays only: the crtc this plane is committed on, 0 if free
 
         Hyprutils::Memory::CSharedPointer<CDRMFB>    front /* currently displaying */, back /* submitted */, last /* keep just in case */;
         Hyprutils::Memory::CWeakPointer<CDRMBackend> backend;
@@ -122,6 +136,7 @@ namespace Aquamarine {
                 uint32_t type;
                 uint32_t rotation;   // Not guaranteed to exist
                 uint32_t in_formats; // Not guaranteed to exist
+                uint32_t zpos;       // Not guaranteed to exist
 
                 // atomic-modesetting only
 
@@ -140,7 +155,7 @@ namespace Aquamarine {
                 uint32_t hotspot_y;
                 uint32_t in_fence_fd;
             } values;
-            uint32_t props[17] = {0};
+            uint32_t props[18] = {0};
         };
         UDRMPlaneProps props;
     };
@@ -157,13 +172,16 @@ namespace Aquamarine {
         struct {
             bool     ownModeID = false;
             uint32_t modeID    = 0;
-            uint32_t gammaLut  = 0;
-            uint32_t ctm       = 0;
+            uint32_t gammaLut   = 0;
+            uint32_t degammaLut = 0;
+            uint32_t ctm        = 0;
         } atomic;
 
-        Hyprutils::Memory::CSharedPointer<SDRMPlane> primary;
-        Hyprutils::Memory::CSharedPointer<SDRMPlane> cursor;
-        Hyprutils::Memory::CWeakPointer<CDRMBackend> backend;
+        Hyprutils::Memory::CSharedPointer<SDRMPlane>              primary;
+        Hyprutils::Memory::CSharedPointer<SDRMPlane>              cursor;
+        std::vector<Hyprutils::Memory::CSharedPointer<SDRMPlane>> overlays;    // usable with this crtc, above its primary, sorted bottom to top
+        std::vector<std::pair<uint32_t, uint64_t>>                overlayZpos; // plane id, zpos to program, for overlays with a mutable zpos
+        Hyprutils::Memory::CWeakPointer<CDRMBackend>              backend;
         Hyprutils::Memory::CSharedPointer<CDRMFB>    pendingCursor;
 
         union UDRMCRTCProps {
@@ -212,10 +230,35 @@ namespace Aquamarine {
 
         bool enabledState = true; // actual enabled state. Should be synced with state->state().enabled after a new frame
 
+        // test() answers taken from the cache instead of a TEST_ONLY commit
+        struct {
+            uint64_t hits = 0, misses = 0;
+        } testCacheStats;
+
+        // Late frames: after a flip, the frame event is held back until just before the next vblank,
+        // leaving as much time as recent frames needed to commit. Saves up to a refresh of latency.
+        // Off by default, AQ_DRM_LATE_FRAMES=1 turns it on for all outputs.
+        void setLateFrames(bool enabled);
+
       private:
         CDRMOutput(const std::string& name_, Hyprutils::Memory::CWeakPointer<CDRMBackend> backend_, Hyprutils::Memory::CSharedPointer<SDRMConnector> connector_);
 
         bool                                                         commitState(bool onlyTest = false);
+        bool                                                         prepareCommit(bool onlyTest, SDRMConnectorCommitData& data, bool canQueue = false);
+        void                                                         finishCommit(const SDRMConnectorCommitData& data);
+        void                                                         assignLayers(SDRMConnectorCommitData& data);
+        bool                                                         reuseLayerAssignment(SDRMConnectorCommitData& data);
+        std::string                                                  testSignature(const SDRMConnectorCommitData& data);
+        void                                                         invalidateTestCache();
+        void                                                         sendFrame(bool late = false);
+        bool                                                         scheduleLateFrame(uint64_t flipNs); // false if the frame should go out now
+        bool                                                         canCommitCursor();
+        bool                                                         awaitingFrame(uint64_t now);
+        void                                                         scheduleCursorCommit();
+        void                                                         commitCursor();
+        void                                                         queueMailbox(const SDRMConnectorCommitData& data);
+        void                                                         submitMailbox();
+        void                                                         discardMailbox();
 
         Hyprutils::Memory::CWeakPointer<CDRMBackend>                 backend;
         Hyprutils::Memory::CSharedPointer<SDRMConnector>             connector;
@@ -224,20 +267,85 @@ namespace Aquamarine {
         struct {
             Hyprutils::Memory::CSharedPointer<ISwapchain> swapchain;
             Hyprutils::Memory::CSharedPointer<ISwapchain> cursorSwapchain;
+
+            // damage of the last few blits, newest first, to bring older swapchain buffers up to date
+            std::deque<Hyprutils::Math::CRegion> damageRing;
+
+            // for sources the blitting gpu can't import
+            Hyprutils::Memory::CSharedPointer<CDRMReadback> readback;
         } mgpu;
 
         bool lastCommitNoBuffer = true;
 
+        // the last layer -> overlay plane assignment, reused without any TEST_ONLY commits
+        // as long as the layers keep their shape
+        struct SLayerAssignment {
+            Hyprutils::Memory::CWeakPointer<SOutputLayer> layer;
+            Hyprutils::Memory::CWeakPointer<SDRMPlane>    plane; // null if rejected
+            Hyprutils::Math::CBox                         src, dst;
+            Hyprutils::Math::eTransform                   transform = Hyprutils::Math::HYPRUTILS_TRANSFORM_NORMAL;
+            Hyprutils::Math::Vector2D                     size;
+            uint32_t                                      format   = DRM_FORMAT_INVALID;
+            uint64_t                                      modifier = DRM_FORMAT_MOD_INVALID;
+        };
+        std::vector<SLayerAssignment> lastLayerAssignment;
+
+        // TEST_ONLY results by testSignature(). Only valid while the rest of the device stays the same.
+        std::unordered_map<std::string, bool> testCache;
+
+        struct {
+            bool                    enabled      = false;
+            uint64_t                deadline     = 0; // CLOCK_MONOTONIC ns of the held back frame event, 0 if none
+            uint64_t                targetVblank = 0; // the vblank the last late frame aimed for
+            bool                    lateSent     = false; // the last frame event was a late one
+            bool                    committed    = false; // and it was answered with a buffer
+            uint64_t                frameSent    = 0;
+            uint64_t                margin       = 0; // on top of the render time, grows on misses
+
+            std::array<uint64_t, 8> renderTimes = {0}; // frame event -> commit, ns
+            size_t                  renderSamples = 0;
+        } lateFrames;
+
+        // Cursor moves on an idle output don't need a frame from the compositor: they go out in cursor-only
+        // commits, at most one per vblank, sampled just before it. A primary commit takes them along instead.
+        struct {
+            bool     dirty      = false; // cursorPos wasn't committed yet
+            uint64_t deadline   = 0;     // CLOCK_MONOTONIC ns of the next cursor-only commit, 0 if none
+            uint64_t lastVblank = 0;
+        } cursorCommit;
+
+        // mailbox mode: the newest commit that came in while a flip was pending, with the state it was made with.
+        // Submitted from the pf handler.
+        struct {
+            Hyprutils::Memory::CSharedPointer<SDRMConnectorCommitData> data;
+            COutputState::SInternalState                               state;
+            std::vector<Hyprutils::Memory::CSharedPointer<IBuffer>>    locked; // held for the queued commit, KMS takes over on submit
+        } mailbox;
+
         friend struct SDRMConnector;
         friend class CDRMLease;
+        friend class CDRMBackend;
+        friend class CDRMAtomicImpl;
     };
 
     struct SDRMPageFlip {
+        Hyprutils::Memory::CSharedPointer<SDRMConnector> connectorFromCRTC(uint32_t crtcID);
+
         Hyprutils::Memory::CWeakPointer<SDRMConnector> connector;
+        Hyprutils::Memory::CWeakPointer<CDRMBackend>   backend; // set instead of connector for multi-crtc commits, the crtc id tells them apart
+        bool                                           cursorOnly = false; // nothing was presented, only the cursor moved
+    };
+
+    struct SDRMOverlayCommit {
+        Hyprutils::Memory::CSharedPointer<SOutputLayer> layer;
+        Hyprutils::Memory::CSharedPointer<SDRMPlane>    plane;
+        Hyprutils::Memory::CSharedPointer<CDRMFB>       fb;
     };
 
     struct SDRMConnectorCommitData {
         Hyprutils::Memory::CSharedPointer<CDRMFB> mainFB, cursorFB;
+        std::vector<SDRMOverlayCommit>            overlays;               // only programmed if overlaysChanged
+        bool                                      overlaysChanged = false; // if set, overlay planes not in overlays are disabled
         bool                                      modeset  = false;
         bool                                      blocking = false;
         uint32_t                                  flags    = 0;
@@ -276,6 +384,8 @@ namespace Aquamarine {
         void                                           applyCommit(const SDRMConnectorCommitData& data);
         void                                           rollbackCommit(const SDRMConnectorCommitData& data);
         void                                           onPresent();
+        void                                           frameAfterFlip(const timespec& presented);
+        void                                           afterFlip(const timespec& presented);
         void                                           recheckCRTCProps();
 
         Hyprutils::Memory::CSharedPointer<CDRMOutput>  output;
@@ -296,7 +406,9 @@ namespace Aquamarine {
         Hyprutils::Memory::CSharedPointer<CDRMFB>      pendingCursorFB;
 
         bool                                           isPageFlipPending = false;
+        bool                                           cursorFlipPending = false; // a cursor-only commit is in flight, buffers queue behind it
         SDRMPageFlip                                   pendingPageFlip;
+        SDRMPageFlip                                   cursorPageFlip;
         bool                                           frameEventScheduled = false;
 
         // the current state is invalid and won't commit, don't try to modeset.
@@ -305,7 +417,8 @@ namespace Aquamarine {
         Hyprutils::Memory::CSharedPointer<SOutputMode> fallbackMode;
 
         struct {
-            bool vrrEnabled = false;
+            bool     vrrEnabled = false;
+            uint32_t hdrBlob    = 0;
         } atomic;
 
         union UDRMConnectorProps {
@@ -377,6 +490,11 @@ namespace Aquamarine {
         bool                                                               sessionActive();
         int                                                                getNonMasterFD();
 
+        // Commits the pending states of several outputs of this backend in a single atomic request. Either all
+        // of them apply, flipping on the same vblank if the crtcs are in sync, or none do. With onlyTest, the
+        // states are only validated together. Atomic only, and presentation has to be vsync.
+        bool commitOutputs(const std::vector<Hyprutils::Memory::CSharedPointer<IOutput>>& outputs, bool onlyTest = false);
+
         std::vector<FIdleCallback>                                         idleCallbacks;
         std::string                                                        gpuName;
         virtual int                                                        drmRenderNodeFD();
@@ -398,18 +516,40 @@ namespace Aquamarine {
         void scanLeases();
         void restoreAfterVT();
         void recheckOutputs();
+        bool recheckConnector(uint32_t id); // false if it takes a full rescan
         void recheckCRTCs();
+        void queueHotplug(const CSessionDevice::SChangeEvent& event);
+        void dispatchHotplugs();
         void buildGlFormats(const std::vector<SGLFormat>& fmts);
+        void invalidateTestCaches();
+        void releaseOverlays();
+        void updateTimer();
+        void dispatchTimer();
 
         Hyprutils::Memory::CSharedPointer<CSessionDevice>     gpu;
         Hyprutils::Memory::CSharedPointer<IDRMImplementation> impl;
+        Hyprutils::Memory::CSharedPointer<CDRMBlobCache>      blobCache;
+        Hyprutils::Memory::CSharedPointer<CDRMFBCache>        fbCache;
         Hyprutils::Memory::CWeakPointer<CDRMBackend>          primary;
+        SDRMPageFlip                                          transactionPageFlip; // user data of commitOutputs
+        int                                                   timerFD = -1; // late frames, cursor commits and hotplugs, armed for the earliest deadline
+
+        // udev hotplug events, gathered for a bit and then handled at once
+        struct {
+            std::vector<uint32_t> connectors;       // CONNECTOR ids of targeted events
+            bool                  full     = false; // an event without one
+            uint64_t              deadline = 0;
+        } pendingHotplug;
 
         struct {
             Hyprutils::Memory::CSharedPointer<IAllocator>   allocator;
-            Hyprutils::Memory::CSharedPointer<CDRMRenderer> renderer; // may be null if creation fails
+            Hyprutils::Memory::CSharedPointer<CDRMRenderer> renderer;          // may be null if creation fails
+            bool                                            attempted = false; // initMgpu tries once, secondaries only when they first blit
         } rendererState;
 
+        // connectors probed off the main thread at startup, the first scan uses these instead of probing again
+        std::unordered_map<uint32_t, drmModeConnector*>               probedConnectors;
+
         Hyprutils::Memory::CWeakPointer<CBackend>                     backend;
 
         std::vector<Hyprutils::Memory::CSharedPointer<SDRMCRTC>>      crtcs;
@@ -448,5 +588,7 @@ namespace Aquamarine {
         friend class CDRMAtomicRequest;
         friend class CDRMLease;
         friend class CGBMBuffer;
+        friend class CDRMBlobCache;
+        friend class CDRMFBCache;
     };
 };
@@ -5,6 +5,9 @@
 #include "../output/Output.hpp"
 #include <hyprutils/memory/WeakPtr.hpp>
 #include <memory>
+#include <chrono>
+#include <string_view>
+#include <unordered_map>
 #include <tab_client.h>
 
 namespace Aquamarine {
@@ -26,14 +29,42 @@ namespace Aquamarine {
         virtual void                                                      scheduleFrame(const scheduleFrameReason reason = AQ_SCHEDULE_UNKNOWN);
         virtual bool                                                      destroy();
         virtual std::vector<SDRMFormat>                                   getRenderFormats();
+        virtual bool                                                      setCursor(Hyprutils::Memory::CSharedPointer<IBuffer> buffer, const Hyprutils::Math::Vector2D& hotspot);
+        virtual void                                                      moveCursor(const Hyprutils::Math::Vector2D& coord, bool skipSchedule = false);
+        virtual void                                                      setCursorVisible(bool visible);
+        virtual Hyprutils::Math::Vector2D                                 cursorPlaneSize();
         Hyprutils::Memory::CWeakPointer<CTabOutput>                       self;
 
       private:
         CTabOutput(const TabMonitorInfo& monitor_info, Hyprutils::Memory::CWeakPointer<CTabBackend> backend);
 
-        Hyprutils::Memory::CWeakPointer<CTabBackend> backend;
+        void                                                         emitFrame();
+        void                                                         onFrameDone(const TabFrameDone& done);
+        bool                                                         sendCursorBuffer();
 
-        std::string monitor_id;
+        Hyprutils::Memory::CWeakPointer<CTabBackend>                 backend;
+        Hyprutils::Memory::CSharedPointer<std::function<void(void)>> frameIdle;
+
+        std::string                                                  monitor_id;
+        std::vector<TabDamageRect>                                   damageRects; // reused across commits
+
+        struct {
+            bool                                  scheduled         = false; // a frame event is queued, either on idle or on the frame timer
+            bool                                  awaitingFrameDone = false; // we swapped, and the server hasn't released a target yet
+            std::chrono::steady_clock::time_point nextFrame;                 // earliest point for the next frame event
+            std::chrono::steady_clock::time_point frameDoneDeadline;         // when we stop waiting for FRAME_DONE
+            std::chrono::nanoseconds              refreshInterval = std::chrono::nanoseconds{16666667};
+        } frameState;
+
+        // the cursor lives on its own channel, so that pointer motion is a position
+        // message to the server instead of a full frame
+        struct {
+            Hyprutils::Memory::CSharedPointer<IBuffer> buffer;
+            Hyprutils::Math::Vector2D                  hotspot;
+            Hyprutils::Math::Vector2D                  position  = {-1, -1};
+            Hyprutils::Math::Vector2D                  planeSize = {-1, -1};
+            bool                                       visible   = true;
+        } cursorState;
 
         friend class CTabBackend;
     };
@@ -51,6 +82,7 @@ namespace Aquamarine {
         virtual void                                                       onReady();
         virtual std::vector<SDRMFormat>                                    getRenderFormats();
         virtual std::vector<SDRMFormat>                                    getCursorFormats();
+        virtual std::vector<SDRMFormat>                                    getRenderableFormats();
         bool                                                       createOutput(const TabMonitorInfo* monitor_info);
         virtual Hyprutils::Memory::CSharedPointer<IAllocator>              preferredAllocator();
         virtual std::vector<Hyprutils::Memory::CSharedPointer<IAllocator>> getAllocators();
@@ -60,23 +92,60 @@ namespace Aquamarine {
         virtual int                                                        drmRenderNodeFD();
         
       private:
-        int timerFd;
         CTabBackend(Hyprutils::Memory::CSharedPointer<CBackend> backend_);
 
         void handleInput(TabInputEvent* event,bool& pointerDirty,bool& touchDirty);
+        Hyprutils::Memory::CSharedPointer<CTabOutput> outputFromID(std::string_view id);
+
+        // lets us look up outputs by the ids the server sends without building a std::string
+        struct SMonitorIDHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view id) const noexcept {
+                return std::hash<std::string_view>{}(id);
+            }
+        };
+
         Hyprutils::Memory::CWeakPointer<CBackend>                      backend;
         std::vector<Hyprutils::Memory::CSharedPointer<CTabOutput>>     outputs;
+        std::unordered_map<std::string, Hyprutils::Memory::CWeakPointer<CTabOutput>, SMonitorIDHash, std::equal_to<>> outputsByID;
+        std::vector<Hyprutils::Memory::CSharedPointer<CTabOutput>>     dueOutputs; // scratch for dispatchFrameTimer
         TabClientHandle*                                               m_pClient = nullptr;
 
         Hyprutils::Memory::CSharedPointer<IKeyboard>                   m_pKeyboard;
         Hyprutils::Memory::CSharedPointer<IPointer>                    m_pPointer;
         Hyprutils::Memory::CSharedPointer<ITouch>                      m_pTouch;
         Hyprutils::Memory::CSharedPointer<ITablet>                     m_pTablet;
+        Hyprutils::Memory::CSharedPointer<ITabletTool>                 m_pTabletTool;
         Hyprutils::Memory::CSharedPointer<ITabletPad>                  m_pTabletPad;
         Hyprutils::Memory::CSharedPointer<ISwitch>                     m_pSwitch;
 
         size_t                                                         outputIDCounter = 0;
 
+        struct {
+            int  fd      = -1; // the tab_client connection fd, or the fallback timer
+            int  timerFD = -1; // only created with AQ_TAB_POLL_TIMER or if the client exposes no fd
+            bool polling = false;
+        } pollState;
+
+        int  frameTimerFD = -1; // paces frame events to the monitor refresh rate
+
+        // tab_client reads the socket while it waits for the reply to a synchronous call (acquire,
+        // swap) and queues whatever else arrived. The socket is drained by then, so the poll fd
+        // won't wake us up for those, and we pick them up on idle instead.
+        Hyprutils::Memory::CSharedPointer<std::function<void(void)>> drainIdle;
+        bool                                                         drainScheduled = false;
+
+        // format + modifier pairs the server can allocate frame targets with, narrowed down
+        // to what our renderer can import. Empty if the server didn't advertise any.
+        std::vector<SDRMFormat> formats;
+
+        void initPollFD();
+        void scheduleDrain();
+        void drainEvents();
+        void queryFormats();
+        void updateFrameTimer();
+        void dispatchFrameTimer();
+
         friend class CBackend;
         friend class CTabOutput;
     };
@@ -10,6 +10,15 @@ namespace Aquamarine {
         virtual bool reset();
         virtual bool moveCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, bool skipSchedule = false);
 
+        // commits all connectors in one request, all or nothing
+        bool commitConnectors(const std::vector<std::pair<Hyprutils::Memory::CSharedPointer<SDRMConnector>, SDRMConnectorCommitData*>>& connectors, bool test);
+
+        // one blocking modeset with all connectors after a vt switch, everything else on the device is turned off
+        bool restore(const std::vector<std::pair<Hyprutils::Memory::CSharedPointer<SDRMConnector>, SDRMConnectorCommitData*>>& connectors);
+
+        // moves the cursor plane to the output's cursorPos, touching nothing else
+        bool commitCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector);
+
       private:
         bool                                         prepareConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
 
@@ -27,13 +36,17 @@ namespace Aquamarine {
         void addConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
         void addConnectorModeset(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
         void addConnectorCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
-        bool commit(uint32_t flagssss);
+        void addConnectorOverlays(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
+        bool commit(uint32_t flagssss, SDRMPageFlip* pageFlip = nullptr); // pageFlip overrides the connectors' user data
         void add(uint32_t id, uint32_t prop, uint64_t val);
         void planeProps(Hyprutils::Memory::CSharedPointer<SDRMPlane> plane, Hyprutils::Memory::CSharedPointer<CDRMFB> fb, uint32_t crtc, Hyprutils::Math::Vector2D pos);
         void planePropsPos(Hyprutils::Memory::CSharedPointer<SDRMPlane> plane, Hyprutils::Math::Vector2D pos);
+        void planePropsLayer(Hyprutils::Memory::CSharedPointer<SDRMPlane> plane, Hyprutils::Memory::CSharedPointer<CDRMFB> fb, Hyprutils::Memory::CSharedPointer<SDRMCRTC> crtc,
+                             const SOutputLayer& layer);
 
-        void rollback(SDRMConnectorCommitData& data);
-        void apply(SDRMConnectorCommitData& data);
+        // roll back / apply the blobs of every connector added to this request
+        void rollback();
+        void apply();
 
         bool failed = false;
 
@@ -41,9 +54,11 @@ namespace Aquamarine {
         void                                             destroyBlob(uint32_t id);
         void                                             commitBlob(uint32_t* current, uint32_t next);
         void                                             rollbackBlob(uint32_t* current, uint32_t next);
+        void                                             rollbackConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
+        void                                             applyConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
 
         Hyprutils::Memory::CWeakPointer<CDRMBackend>     backend;
         drmModeAtomicReq*                                req = nullptr;
-        Hyprutils::Memory::CSharedPointer<SDRMConnector> conn;
+        std::vector<std::pair<Hyprutils::Memory::CSharedPointer<SDRMConnector>, SDRMConnectorCommitData*>> conns; // data is null with setConnector
     };
 };
@@ -27,6 +27,7 @@ namespace Aquamarine {
     enum eOutputPresentationMode : uint32_t {
         AQ_OUTPUT_PRESENTATION_VSYNC = 0,
         AQ_OUTPUT_PRESENTATION_IMMEDIATE, // likely tearing
+        AQ_OUTPUT_PRESENTATION_MAILBOX,   // vsync, but commits while a flip is pending wait for it, a newer one replaces the waiting one
     };
 
     enum eSubpixelMode : uint32_t {
@@ -38,6 +39,20 @@ namespace Aquamarine {
         AQ_SUBPIXEL_VERTICAL_BGR,
     };
 
+    /*
+        A buffer the compositor would like scanned out directly, on top of the primary buffer.
+        Backends that can put it on a hw plane set accepted after a test() or commit(), the
+        compositor only has to render the layers that weren't.
+    */
+    struct SOutputLayer {
+        Hyprutils::Memory::CSharedPointer<IBuffer> buffer;
+        Hyprutils::Math::CBox                      src; // in buffer pixels, empty means the whole buffer
+        Hyprutils::Math::CBox                      dst; // in output pixels
+        int                                        zpos      = 0; // higher is on top
+        Hyprutils::Math::eTransform                transform = Hyprutils::Math::HYPRUTILS_TRANSFORM_NORMAL;
+        bool                                       accepted  = false; // set by the backend
+    };
+
     class IOutput;
 
     class COutputState {
@@ -59,6 +74,7 @@ namespace Aquamarine {
             AQ_OUTPUT_STATE_WCG                = (1 << 13),
             AQ_OUTPUT_STATE_CURSOR_SHAPE       = (1 << 14),
             AQ_OUTPUT_STATE_CURSOR_POS         = (1 << 15),
+            AQ_OUTPUT_STATE_LAYERS             = (1 << 16),
         };
 
         struct SInternalState {
@@ -80,6 +96,7 @@ namespace Aquamarine {
             bool                                           wideColorGamut = false;
             hdr_output_metadata                            hdrMetadata;
             uint16_t                                       contentType = DRM_MODE_CONTENT_TYPE_GRAPHICS;
+            std::vector<Hyprutils::Memory::CSharedPointer<SOutputLayer>> layers;
         };
 
         const SInternalState& state();
@@ -102,6 +119,7 @@ namespace Aquamarine {
         void                  setWideColorGamut(bool wcg);
         void                  setHDRMetadata(const hdr_output_metadata& metadata);
         void                  setContentType(const uint16_t drmContentType);
+        void                  setLayers(const std::vector<Hyprutils::Memory::CSharedPointer<SOutputLayer>>& layers); // empty removes all
 
       private:
         SInternalState internalState;
@@ -27,6 +27,7 @@ bool Aquamarine::CLegacySwapchain::reconfigure(const SSwapchainOptions& options_
         // clear the swapchain
         allocator->getBackend()->log(AQ_LOG_DEBUG, "Swapchain: Clearing");
         buffers.clear();
+        acquiredAt.clear();
         options = options_;
         return true;
     }
@@ -63,10 +64,26 @@ SP<IBuffer> Aquamarine::CLegacySwapchain::next(int* age) {
     if (!allocator || options.length <= 0)
         return nullptr;
 
-    lastAcquired = (lastAcquired + 1) % options.length;
+    // skip buffers the backend still scans out, or holds for a queued commit. If all of them are
+    // held, hand out the next one in order as before, it's the consumer's job to not overrun us.
+    int idx = lastAcquired;
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        idx = (idx + 1) % options.length;
+        if (!buffers.at(idx)->lockedByBackend)
+            break;
+    }
+
+    if (buffers.at(idx)->lockedByBackend)
+        idx = (lastAcquired + 1) % options.length;
+
+    lastAcquired = idx;
+    acquireCount++;
 
+    // how many frames ago this buffer was last handed out, 0 if its contents are undefined
+    auto& acquired = acquiredAt.at(lastAcquired);
     if (age)
-        *age = options.length; // we always just rotate
+        *age = acquired ? (int)(acquireCount - acquired) : 0;
+    acquired = acquireCount;
 
     return buffers.at(lastAcquired);
 }
@@ -87,6 +104,7 @@ bool Aquamarine::CLegacySwapchain::fullReconfigure(const SSwapchainOptions& opti
     }
 
     buffers = std::move(bfs);
+    acquiredAt.assign(buffers.size(), 0);
 
     return true;
 }
@@ -111,6 +129,8 @@ bool Aquamarine::CLegacySwapchain::resize(size_t newSize) {
         }
     }
 
+    acquiredAt.resize(buffers.size(), 0);
+
     return true;
 }
 
@@ -123,6 +143,10 @@ const SSwapchainOptions& Aquamarine::CLegacySwapchain::currentOptions() {
 }
 
 void Aquamarine::CLegacySwapchain::rollback() {
+    // whatever the consumer did to it, we can't vouch for the contents anymore
+    if (lastAcquired >= 0 && (size_t)lastAcquired < acquiredAt.size())
+        acquiredAt.at(lastAcquired) = 0;
+
     lastAcquired--;
     if (lastAcquired < 0)
         lastAcquired = options.length - 1;
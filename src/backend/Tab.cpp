@@ -6,10 +6,18 @@
 #include <aquamarine/backend/Tab.hpp>
 #include <aquamarine/backend/Backend.hpp>
 #include <aquamarine/input/Input.hpp>
+#include <algorithm>
 #include <cstdlib>
 #include <drm_fourcc.h>
 #include <fcntl.h>
+#include <optional>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstring>
 #include <sys/timerfd.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <linux/dma-buf.h>
 
 extern "C" {
 #include <tab_client.h>
@@ -20,6 +28,11 @@ using namespace Hyprutils::Memory;
 using namespace Hyprutils::Math;
 #define SP CSharedPointer
 
+// if the server doesn't send FRAME_DONE for this many refreshes, we stop waiting for it
+constexpr int FRAME_DONE_TIMEOUT_REFRESHES = 4;
+// if a target's release fence doesn't signal within this many refreshes, its acquire fails
+constexpr int RELEASE_FENCE_TIMEOUT_REFRESHES = 2;
+
 class CTabKeyboard : public IKeyboard {
   public:
     CTabKeyboard() {
@@ -136,12 +149,63 @@ class CTabSwitch : public ISwitch {
     }
 };
 
+// identifies a server-side frame target across acquires. The server hands us a new fd every time,
+// but the dmabuf behind it (and thus its inode) stays the same.
+struct STabTargetIdentity {
+    dev_t    dev    = 0;
+    ino_t    ino    = 0;
+    uint32_t offset = 0;
+
+    bool     operator==(const STabTargetIdentity&) const = default;
+};
+
+static std::optional<STabTargetIdentity> targetIdentity(const TabFrameTarget& target) {
+    struct stat st;
+    if (target.dmabuf.fd < 0 || fstat(target.dmabuf.fd, &st) != 0)
+        return std::nullopt;
+
+    return STabTargetIdentity{.dev = st.st_dev, .ino = st.st_ino, .offset = target.dmabuf.offset};
+}
+
+// the server may hand out a target it's still reading from, guarded by a release fence.
+// Attach the fence to the dmabuf so that the renderer's implicit sync waits for it on the gpu,
+// or wait for it here if the kernel can't do that (< 6.0), for at most timeout. Consumes the fence,
+// false if it didn't signal in time.
+static bool attachReleaseFence(int dmabufFD, int fenceFD, std::chrono::nanoseconds timeout) {
+    if (fenceFD < 0)
+        return true;
+
+#ifdef DMA_BUF_IOCTL_IMPORT_SYNC_FILE
+    dma_buf_import_sync_file data = {
+        .flags = DMA_BUF_SYNC_WRITE,
+        .fd    = fenceFD,
+    };
+
+    if (dmabufFD >= 0 && ioctl(dmabufFD, DMA_BUF_IOCTL_IMPORT_SYNC_FILE, &data) == 0) {
+        close(fenceFD);
+        return true;
+    }
+#endif
+
+    const auto DEADLINE = std::chrono::steady_clock::now() + timeout;
+
+    pollfd     pfd = {.fd = fenceFD, .events = POLLIN};
+    int        ret = 0;
+    do {
+        const auto LEFT = std::chrono::ceil<std::chrono::milliseconds>(DEADLINE - std::chrono::steady_clock::now());
+        ret             = poll(&pfd, 1, std::max(0, (int)LEFT.count()));
+    } while (ret < 0 && errno == EINTR);
+
+    close(fenceFD);
+    return ret > 0;
+}
+
 class CTabBuffer : public IBuffer {
     private:
         TabFrameTarget target;
     public:
         CTabBuffer(const TabFrameTarget& target_) : target(target_) {
-            ;
+            size = Hyprutils::Math::Vector2D{(double)target.width, (double)target.height};
         }
         virtual ~CTabBuffer() {
             ;
@@ -163,15 +227,51 @@ class CTabBuffer : public IBuffer {
             attrs.success = true;
             attrs.size = Hyprutils::Math::Vector2D{(double)target.width, (double)target.height};
             attrs.format = target.dmabuf.fourcc;
-            attrs.modifier = DRM_FORMAT_MOD_INVALID;
-            attrs.strides[0] = target.dmabuf.stride;
-            attrs.offsets[0] = target.dmabuf.offset;
-            attrs.fds[0] = target.dmabuf.fd;
+
+            // servers without modifier support only fill in the first plane
+            if (target.dmabuf.plane_count == 0) {
+                attrs.modifier   = DRM_FORMAT_MOD_INVALID;
+                attrs.strides[0] = target.dmabuf.stride;
+                attrs.offsets[0] = target.dmabuf.offset;
+                attrs.fds[0]     = target.dmabuf.fd;
+                return attrs;
+            }
+
+            attrs.modifier = target.dmabuf.modifier;
+            attrs.planes   = std::min<int>(target.dmabuf.plane_count, attrs.fds.size());
+            for (int i = 0; i < attrs.planes; ++i) {
+                attrs.fds[i]     = target.dmabuf.planes[i].fd;
+                attrs.strides[i] = target.dmabuf.planes[i].stride;
+                attrs.offsets[i] = target.dmabuf.planes[i].offset;
+            }
             return attrs;
         }
         virtual bool isSynchronous() {
             return false;
         }
+
+        // whether a freshly acquired target can be served by this buffer
+        bool matches(const TabFrameTarget& other) {
+            if (other.width != target.width || other.height != target.height || other.dmabuf.fourcc != target.dmabuf.fourcc ||
+                other.dmabuf.stride != target.dmabuf.stride || other.dmabuf.modifier != target.dmabuf.modifier ||
+                other.dmabuf.plane_count != target.dmabuf.plane_count)
+                return false;
+
+            for (uint32_t i = 0; i < std::min<uint32_t>(target.dmabuf.plane_count, TAB_MAX_PLANES); ++i) {
+                if (other.dmabuf.planes[i].stride != target.dmabuf.planes[i].stride || other.dmabuf.planes[i].offset != target.dmabuf.planes[i].offset)
+                    return false;
+            }
+
+            return true;
+        }
+
+        // refresh the fd and the rest of the target, keeping the IBuffer (and its attachments) alive
+        void updateTarget(const TabFrameTarget& target_) {
+            target = target_;
+        }
+
+        std::optional<STabTargetIdentity> identity;
+        uint64_t                          lastAcquired = 0; // swapchain frame counter, 0 = never
 };
 
 class CTabSwapchain : public ISwapchain {
@@ -189,10 +289,50 @@ class CTabSwapchain : public ISwapchain {
             TabFrameTarget target;
 
             auto res = tab_client_acquire_frame(tab_client, monitor_id.c_str(), &target);
+            if (onServerCall)
+                onServerCall();
             if (res != TAB_ACQUIRE_OK)
                 return nullptr;
 
-            return CSharedPointer<IBuffer>(new CTabBuffer(target));
+            // don't stall the compositor on a server that doesn't let go of the target
+            if (!attachReleaseFence(target.dmabuf.fd, target.release_fence_fd, refreshInterval * RELEASE_FENCE_TIMEOUT_REFRESHES))
+                return nullptr;
+
+            frameCounter++;
+
+            // hand out the same IBuffer for the same server-side target, so that
+            // consumers can keep their EGLImages / FBOs in the buffer's attachments
+            const auto      ID = targetIdentity(target);
+            SP<CTabBuffer>  buffer;
+
+            if (ID) {
+                auto it = std::ranges::find_if(pool, [&ID](const auto& b) { return b->identity == ID; });
+                if (it != pool.end()) {
+                    if ((*it)->matches(target)) {
+                        buffer = *it;
+                        buffer->updateTarget(target);
+                    } else
+                        pool.erase(it); // same dmabuf, different layout: treat as a new buffer
+                }
+            }
+
+            if (!buffer) {
+                buffer           = makeShared<CTabBuffer>(target);
+                buffer->identity = ID;
+
+                if (ID) {
+                    if (pool.size() >= MAX_POOL_SIZE)
+                        pool.erase(std::ranges::min_element(pool, {}, [](const auto& b) { return b->lastAcquired; }));
+                    pool.emplace_back(buffer);
+                }
+            }
+
+            if (age)
+                *age = buffer->lastAcquired ? (int)(frameCounter - buffer->lastAcquired) : 0;
+
+            buffer->lastAcquired = frameCounter;
+
+            return buffer;
         }
 
         virtual const SSwapchainOptions&                             currentOptions() {
@@ -206,43 +346,134 @@ class CTabSwapchain : public ISwapchain {
         virtual void rollback() {
 
         };
-        CTabSwapchain(const TabMonitorInfo& monitor_info, TabClientHandle* tab_client) {
-            TabFrameTarget target;
-            tab_client_acquire_frame(tab_client, monitor_id.c_str(), &target);
+        // the server allocates the targets, so the format is whatever we negotiated with it.
+        // Don't acquire a target to find out, that would hold it until the first real acquire.
+        CTabSwapchain(const TabMonitorInfo& monitor_info, TabClientHandle* tab_client, const std::vector<SDRMFormat>& formats, std::function<void()>&& onServerCall_) :
+            onServerCall(std::move(onServerCall_)) {
+            uint32_t format = DRM_FORMAT_XRGB8888;
+            if (!formats.empty() && std::ranges::none_of(formats, [](const auto& f) { return f.drmFormat == DRM_FORMAT_XRGB8888; }))
+                format = formats.front().drmFormat;
+
             options = SSwapchainOptions {
                 .length = 2,
                 .size = {monitor_info.width, monitor_info.height},
-                .format = target.dmabuf.fourcc,
+                .format = format,
                 .scanout = false,
                 .cursor = false,
                 .multigpu = false
             };
             this->tab_client = tab_client;
             this->monitor_id = std::string(monitor_info.id);
+
+            // refresh_rate is in Hz
+            refreshInterval = std::chrono::nanoseconds{(int64_t)(1000000000.0 / (monitor_info.refresh_rate > 0 ? monitor_info.refresh_rate : 60.0))};
         };
         ~CTabSwapchain() {
             ;
         }
+
+    private:
+        // tab_client may read events off the socket while waiting for the acquire reply
+        std::function<void()>       onServerCall;
+
+        // the server usually rotates 2-3 targets, anything above that is a leftover from a reallocation
+        constexpr static size_t     MAX_POOL_SIZE = 8;
+
+        std::vector<SP<CTabBuffer>> pool;
+        uint64_t                    frameCounter = 0;
+        std::chrono::nanoseconds    refreshInterval;
 };
 Aquamarine::CTabOutput::CTabOutput(const TabMonitorInfo& monitor_info, Hyprutils::Memory::CWeakPointer<CTabBackend> backend_) : backend(backend_) {
-    this->name = std::string(monitor_info.name);
+    // refresh_rate is in Hz, SOutputMode wants mHz
+    const unsigned int REFRESH_MHZ = monitor_info.refresh_rate > 0 ? (unsigned int)(monitor_info.refresh_rate * 1000) : 60000;
+
+    this->name         = std::string(monitor_info.name);
     this->physicalSize = {(double)monitor_info.width, (double)monitor_info.height};
-    this->swapchain = Hyprutils::Memory::CSharedPointer<ISwapchain>(new CTabSwapchain(monitor_info, backend.lock()->m_pClient));
-    this->monitor_id = std::string(monitor_info.id);
-    this->modes.emplace_back(Hyprutils::Memory::CSharedPointer<SOutputMode>(new SOutputMode(Vector2D{(double)monitor_info.width, (double)monitor_info.height}, 60, true)));
+    this->swapchain    = Hyprutils::Memory::CSharedPointer<ISwapchain>(new CTabSwapchain(monitor_info, backend->m_pClient, backend->formats, [b = backend]() {
+                             if (b)
+                                 b->scheduleDrain();
+                         }));
+    this->monitor_id   = std::string(monitor_info.id);
+    this->modes.emplace_back(Hyprutils::Memory::CSharedPointer<SOutputMode>(new SOutputMode(Vector2D{(double)monitor_info.width, (double)monitor_info.height}, REFRESH_MHZ, true)));
+
+    frameState.refreshInterval = std::chrono::nanoseconds{1000000000000LL / REFRESH_MHZ};
 
+    // 0 means the server has no limit on the cursor size
+    if (monitor_info.cursor_width > 0 && monitor_info.cursor_height > 0)
+        cursorState.planeSize = {(double)monitor_info.cursor_width, (double)monitor_info.cursor_height};
+
+    frameIdle = makeShared<std::function<void(void)>>([this]() { emitFrame(); });
+
+    supportsExplicit = tab_client_supports_explicit_sync(backend->m_pClient);
 }
 
 Aquamarine::CTabOutput::~CTabOutput() {
+    if (backend && backend->backend)
+        backend->backend->removeIdleEvent(frameIdle);
     events.destroy.emit();
 }
 
-
 bool Aquamarine::CTabOutput::commit() {
+    const auto& STATE = state->state();
+
+    // forward the damage so that the server only recomposites what changed.
+    // An empty damage region means we don't know, and the server assumes the whole monitor.
+    damageRects.clear();
+    if ((STATE.committed & COutputState::AQ_OUTPUT_STATE_DAMAGE) && !STATE.damage.empty() && !modes.empty()) {
+        for (auto const& rect : STATE.damage.copy().intersect(CBox{{}, modes.front()->pixelSize}).getRects()) {
+            damageRects.emplace_back(TabDamageRect{
+                .x      = rect.x1,
+                .y      = rect.y1,
+                .width  = rect.x2 - rect.x1,
+                .height = rect.y2 - rect.y1,
+            });
+        }
+    }
+
+    const uint32_t COMMITTED = STATE.committed;
+
+    // nothing new for the server to show, and no FRAME_DONE to wait for
+    if (!(COMMITTED & COutputState::AQ_OUTPUT_STATE_BUFFER)) {
+        events.commit.emit();
+        state->onCommit();
+        return true;
+    }
+
+    bool    swapped  = false;
+    int32_t outFence = -1;
+
+    if (supportsExplicit && (COMMITTED & (COutputState::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE | COutputState::AQ_OUTPUT_STATE_EXPLICIT_OUT_FENCE))) {
+        // the server waits on the in fence before reading the frame, and hands us back a fence
+        // that signals once it's done with it, much like IN_FENCE_FD / OUT_FENCE_PTR on a crtc
+        const int32_t IN_FENCE = (COMMITTED & COutputState::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE) ? STATE.explicitInFence : -1;
+        const bool    WANT_OUT = COMMITTED & COutputState::AQ_OUTPUT_STATE_EXPLICIT_OUT_FENCE;
+
+        swapped = tab_client_swap_buffers_explicit(backend->m_pClient, this->monitor_id.c_str(), damageRects.data(), damageRects.size(), IN_FENCE, WANT_OUT ? &outFence : nullptr);
+    } else if (damageRects.empty())
+        swapped = tab_client_swap_buffers(backend->m_pClient, this->monitor_id.c_str());
+    else
+        swapped = tab_client_swap_buffers_with_damage(backend->m_pClient, this->monitor_id.c_str(), damageRects.data(), damageRects.size());
+
+    // the swap may have queued a FRAME_DONE or input without leaving anything on the socket
+    backend->scheduleDrain();
+
+    if (!swapped) {
+        backend->backend->log(AQ_LOG_ERROR, std::format("Output {}: pending state rejected: swap failed", name));
+        scheduleFrame(AQ_SCHEDULE_NEEDS_FRAME);
+        return false;
+    }
+
+    if (COMMITTED & COutputState::AQ_OUTPUT_STATE_EXPLICIT_OUT_FENCE)
+        state->internalState.explicitOutFence = outFence;
+
     events.commit.emit();
     state->onCommit();
     needsFrame = false;
-    tab_client_swap_buffers(backend->m_pClient, this->monitor_id.c_str());
+
+    frameState.awaitingFrameDone = true;
+    frameState.frameDoneDeadline = std::chrono::steady_clock::now() + frameState.refreshInterval * FRAME_DONE_TIMEOUT_REFRESHES;
+    backend->updateFrameTimer();
+
     return true;
 }
 
@@ -255,12 +486,163 @@ SP<IBackendImplementation> Aquamarine::CTabOutput::getBackend() {
 }
 
 void Aquamarine::CTabOutput::scheduleFrame(const scheduleFrameReason reason) {
+    TRACE(backend->backend->log(AQ_LOG_TRACE,
+                                std::format("CTabOutput::scheduleFrame: reason {}, needsFrame {}, scheduled {}, awaitingFrameDone {}", (uint32_t)reason, needsFrame,
+                                            frameState.scheduled, frameState.awaitingFrameDone)));
     needsFrame = true;
+
+    // if we're waiting on the server, FRAME_DONE will reschedule us.
+    if (frameState.scheduled || frameState.awaitingFrameDone)
+        return;
+
+    frameState.scheduled = true;
+
+    // a new monitor wants its first frame asap, everything else is paced to the refresh rate
+    const bool IMMEDIATE = reason == AQ_SCHEDULE_NEW_CONNECTOR || reason == AQ_SCHEDULE_NEW_MONITOR;
+
+    if (IMMEDIATE || std::chrono::steady_clock::now() >= frameState.nextFrame) {
+        backend->backend->addIdleEvent(frameIdle);
+        return;
+    }
+
+    backend->updateFrameTimer();
+}
+
+void Aquamarine::CTabOutput::emitFrame() {
+    if (!frameState.scheduled)
+        return;
+
+    frameState.scheduled = false;
+
+    if (frameState.awaitingFrameDone)
+        return;
+
+    // allow a bit of slack so that jitter in the server's FRAME_DONE doesn't make us skip a refresh
+    frameState.nextFrame = std::chrono::steady_clock::now() + frameState.refreshInterval - frameState.refreshInterval / 10;
+
+    events.frame.emit();
+}
+
+void Aquamarine::CTabOutput::onFrameDone(const TabFrameDone& done) {
+    // a late FRAME_DONE after we gave up on it, the present was already reported
+    if (!frameState.awaitingFrameDone)
+        return;
+
+    frameState.awaitingFrameDone = false;
+
+    // the server may switch modes / vrr under us, follow its idea of the refresh period
+    if (done.refresh_ns > 0)
+        frameState.refreshInterval = std::chrono::nanoseconds{done.refresh_ns};
+
+    uint32_t flags = 0;
+    if (done.flags & TAB_PRESENT_VSYNC)
+        flags |= IOutput::AQ_OUTPUT_PRESENT_VSYNC;
+    if (done.flags & TAB_PRESENT_HW_CLOCK)
+        flags |= IOutput::AQ_OUTPUT_PRESENT_HW_CLOCK;
+    if (done.flags & TAB_PRESENT_HW_COMPLETION)
+        flags |= IOutput::AQ_OUTPUT_PRESENT_HW_COMPLETION;
+    if (done.flags & TAB_PRESENT_ZEROCOPY)
+        flags |= IOutput::AQ_OUTPUT_PRESENT_ZEROCOPY;
+
+    // a zero timestamp means the server didn't know when the frame hit the screen
+    timespec   presented = {.tv_sec = (time_t)done.tv_sec, .tv_nsec = (long)done.tv_nsec};
+    const bool HAS_TIME  = done.tv_sec != 0 || done.tv_nsec != 0;
+
+    events.present.emit(IOutput::SPresentEvent{
+        .presented = true,
+        .when      = HAS_TIME ? &presented : nullptr,
+        .seq       = (unsigned int)done.sequence,
+        .refresh   = (int)done.refresh_ns,
+        .flags     = flags,
+    });
+
+    if (needsFrame)
+        scheduleFrame(AQ_SCHEDULE_NEEDS_FRAME);
+}
+
+bool Aquamarine::CTabOutput::sendCursorBuffer() {
+    if (!cursorState.buffer || !cursorState.visible)
+        return tab_client_set_cursor(backend->m_pClient, monitor_id.c_str(), nullptr);
+
+    TabCursorBuffer cursor = {
+        .hotspot_x = (int32_t)cursorState.hotspot.x,
+        .hotspot_y = (int32_t)cursorState.hotspot.y,
+    };
+
+    if (auto attrs = cursorState.buffer->dmabuf(); attrs.success) {
+        cursor.kind     = TAB_CURSOR_BUFFER_DMABUF;
+        cursor.width    = (uint32_t)attrs.size.x;
+        cursor.height   = (uint32_t)attrs.size.y;
+        cursor.fourcc   = attrs.format;
+        cursor.modifier = attrs.modifier;
+        cursor.fd       = attrs.fds[0];
+        cursor.stride   = attrs.strides[0];
+        cursor.offset   = attrs.offsets[0];
+    } else if (auto attrs = cursorState.buffer->shm(); attrs.success) {
+        cursor.kind     = TAB_CURSOR_BUFFER_SHM;
+        cursor.width    = (uint32_t)attrs.size.x;
+        cursor.height   = (uint32_t)attrs.size.y;
+        cursor.fourcc   = attrs.format;
+        cursor.modifier = DRM_FORMAT_MOD_LINEAR;
+        cursor.fd       = attrs.fd;
+        cursor.stride   = (uint32_t)attrs.stride;
+        cursor.offset   = (uint32_t)attrs.offset;
+    } else {
+        backend->backend->log(AQ_LOG_ERROR, std::format("tab backend: Output {}: cursor buffer is neither dmabuf nor shm", name));
+        return false;
+    }
+
+    return tab_client_set_cursor(backend->m_pClient, monitor_id.c_str(), &cursor);
+}
+
+bool Aquamarine::CTabOutput::setCursor(SP<IBuffer> buffer, const Vector2D& hotspot) {
+    if (buffer && !buffer->good()) {
+        backend->backend->log(AQ_LOG_ERROR, std::format("tab backend: Output {}: bad buffer passed to setCursor", name));
+        return false;
+    }
+
+    // keep the buffer alive for as long as the server may still read from it
+    cursorState.buffer  = buffer;
+    cursorState.hotspot = hotspot;
+
+    if (!sendCursorBuffer()) {
+        backend->backend->log(AQ_LOG_ERROR, std::format("tab backend: Output {}: server rejected the cursor buffer", name));
+        cursorState.buffer.reset();
+        return false;
+    }
+
+    return true;
+}
+
+void Aquamarine::CTabOutput::moveCursor(const Vector2D& coord, bool skipSchedule) {
+    // never schedules a frame, the server moves the plane on its own
+    if (coord == cursorState.position)
+        return;
+
+    cursorState.position = coord;
+    tab_client_move_cursor(backend->m_pClient, monitor_id.c_str(), (int32_t)coord.x, (int32_t)coord.y);
+}
+
+void Aquamarine::CTabOutput::setCursorVisible(bool visible) {
+    if (cursorState.visible == visible)
+        return;
+
+    cursorState.visible = visible;
+    sendCursorBuffer();
+}
+
+Vector2D Aquamarine::CTabOutput::cursorPlaneSize() {
+    return cursorState.planeSize;
 }
 
 bool Aquamarine::CTabOutput::destroy() {
+    if (backend && backend->backend)
+        backend->backend->removeIdleEvent(frameIdle);
     events.destroy.emit();
-    std::erase_if(backend.lock()->outputs, [this](const auto& other) { return other.get() == this; });
+    if (auto be = backend.lock()) {
+        be->outputsByID.erase(monitor_id);
+        std::erase_if(be->outputs, [this](const auto& other) { return other.get() == this; });
+    }
     return true;
 }
 
@@ -273,18 +655,56 @@ std::vector<SDRMFormat> Aquamarine::CTabOutput::getRenderFormats() {
 Aquamarine::CTabBackend::~CTabBackend() {
     if (m_pClient)
         tab_client_disconnect(m_pClient);
+
+    if (pollState.timerFD >= 0)
+        close(pollState.timerFD);
+
+    if (frameTimerFD >= 0)
+        close(frameTimerFD);
+
+    if (backend)
+        backend->removeIdleEvent(drainIdle);
 }
 
 Aquamarine::CTabBackend::CTabBackend(SP<CBackend> backend_) : backend(backend_) {
+    frameTimerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    drainIdle    = makeShared<std::function<void(void)>>([this]() {
+        drainScheduled = false;
+        drainEvents();
+    });
+}
 
-    timerFd  = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+void Aquamarine::CTabBackend::initPollFD() {
+    // the connection socket becomes readable whenever the server sends something, so we only
+    // wake up on real traffic. The 1ms timer is kept as a fallback for debugging or for
+    // clients that don't expose their socket.
+    const int socketFD = tab_client_get_socket_fd(m_pClient);
+
+    if (socketFD >= 0 && !envEnabled("AQ_TAB_POLL_TIMER")) {
+        pollState.fd      = socketFD;
+        pollState.polling = false;
+        backend->log(AQ_LOG_DEBUG, std::format("tab backend: dispatching on the client socket fd {}", socketFD));
+        return;
+    }
 
-    struct itimerspec its = {
-        .it_interval = {0, 1000000},  // continuous
+    if (socketFD < 0)
+        backend->log(AQ_LOG_WARNING, "tab backend: client exposes no socket fd, falling back to a polling timer");
+    else
+        backend->log(AQ_LOG_WARNING, "tab backend: AQ_TAB_POLL_TIMER enabled, falling back to a polling timer");
+
+    if (pollState.timerFD < 0)
+        pollState.timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    itimerspec its = {
+        .it_interval = {0, 1000000}, // continuous
         .it_value    = {0, 1000000},
     };
 
-    timerfd_settime(timerFd, 0, &its, NULL);
+    if (timerfd_settime(pollState.timerFD, 0, &its, nullptr))
+        backend->log(AQ_LOG_ERROR, std::format("tab backend: failed to arm timerfd: {}", strerror(errno)));
+
+    pollState.fd      = pollState.timerFD;
+    pollState.polling = true;
 }
 
 eBackendType Aquamarine::CTabBackend::type() {
@@ -301,6 +721,9 @@ bool Aquamarine::CTabBackend::start() {
 
     std::cout << "tab backend: Client connected successfully.\n";
 
+    initPollFD();
+    queryFormats();
+
     for (size_t i = 0; i < tab_client_get_monitor_count(m_pClient); ++i) {
         char* mon_id = tab_client_get_monitor_id(m_pClient, i);
         auto monitor_info = tab_client_get_monitor_info(m_pClient, mon_id);
@@ -318,7 +741,64 @@ std::vector<SP<SPollFD>> Aquamarine::CTabBackend::pollFDs() {
     if (!m_pClient)
         return {};
 
-    return {SP<SPollFD>(new SPollFD{.fd=timerFd, .onSignal=[this]() { dispatchEvents(); }})};
+    return {
+        SP<SPollFD>(new SPollFD{.fd = pollState.fd, .onSignal = [this]() { dispatchEvents(); }}),
+        SP<SPollFD>(new SPollFD{.fd = frameTimerFD, .onSignal = [this]() { dispatchFrameTimer(); }}),
+    };
+}
+
+void Aquamarine::CTabBackend::updateFrameTimer() {
+    const auto               NOW    = std::chrono::steady_clock::now();
+    std::chrono::nanoseconds lowest = std::chrono::nanoseconds::max();
+
+    for (auto const& o : outputs) {
+        if (o->frameState.awaitingFrameDone)
+            lowest = std::min(lowest, std::chrono::duration_cast<std::chrono::nanoseconds>(o->frameState.frameDoneDeadline - NOW));
+        else if (o->frameState.scheduled)
+            lowest = std::min(lowest, std::chrono::duration_cast<std::chrono::nanoseconds>(o->frameState.nextFrame - NOW));
+    }
+
+    itimerspec ts = {};
+
+    if (lowest != std::chrono::nanoseconds::max()) {
+        // a zero it_value disarms the timer, so clamp it to 1ns
+        const int64_t NS = std::max<int64_t>(lowest.count(), 1);
+        ts.it_value      = {.tv_sec = (time_t)(NS / 1000000000LL), .tv_nsec = (long)(NS % 1000000000LL)};
+    }
+
+    if (timerfd_settime(frameTimerFD, 0, &ts, nullptr))
+        backend->log(AQ_LOG_ERROR, std::format("tab backend: failed to arm frame timerfd: {}", strerror(errno)));
+}
+
+void Aquamarine::CTabBackend::dispatchFrameTimer() {
+    uint64_t expirations = 0;
+    read(frameTimerFD, &expirations, sizeof(expirations));
+
+    const auto NOW = std::chrono::steady_clock::now();
+
+    // frame listeners may add or remove outputs, so collect first
+    dueOutputs.clear();
+    for (auto const& o : outputs) {
+        if (o->frameState.awaitingFrameDone ? NOW >= o->frameState.frameDoneDeadline : (o->frameState.scheduled && NOW >= o->frameState.nextFrame))
+            dueOutputs.emplace_back(o);
+    }
+
+    for (auto const& o : dueOutputs) {
+        if (!o->frameState.awaitingFrameDone) {
+            o->emitFrame();
+            continue;
+        }
+
+        // the server lost our frame, or is stuck. Don't wait on it forever
+        backend->log(AQ_LOG_WARNING, std::format("tab backend: no FRAME_DONE for {} after {} refreshes, not waiting for it anymore", o->name, FRAME_DONE_TIMEOUT_REFRESHES));
+        o->frameState.awaitingFrameDone = false;
+        if (o->needsFrame)
+            o->scheduleFrame(IOutput::AQ_SCHEDULE_NEEDS_FRAME);
+    }
+
+    dueOutputs.clear();
+
+    updateFrameTimer();
 }
 
 int Aquamarine::CTabBackend::drmFD() {
@@ -330,45 +810,55 @@ int Aquamarine::CTabBackend::drmRenderNodeFD() {
 }
 
 bool Aquamarine::CTabBackend::dispatchEvents() {
-    uint64_t expirations;
-    read(timerFd, &expirations, sizeof(expirations));
+    if (pollState.polling) {
+        uint64_t expirations = 0;
+        read(pollState.timerFD, &expirations, sizeof(expirations));
+    }
+
     if (!m_pClient)
         return true;
     tab_client_poll_events(m_pClient);
+    drainEvents();
+
+    return true;
+}
+
+void Aquamarine::CTabBackend::scheduleDrain() {
+    if (drainScheduled)
+        return;
+
+    drainScheduled = true;
+    backend->addIdleEvent(drainIdle);
+}
+
+void Aquamarine::CTabBackend::drainEvents() {
+    if (!m_pClient)
+        return;
+
     bool pointerDirty = false, touchDirty = false;
     TabEvent event;
     while (tab_client_next_event(m_pClient, &event)) {
         switch (event.event_type) {
             case TAB_EVENT_FRAME_DONE: {
-                auto mon_id = event.data.frame_done;
-                for (auto& output : outputs) {
-                    if (output->monitor_id == mon_id) {
-                        output->needsFrame = false;
-                        output->events.present.emit(IOutput::SPresentEvent{.presented = true});
-                        break;
-                    }
-                }
-                tab_client_string_free(mon_id);
+                const auto& DONE = event.data.frame_done;
+                if (auto output = outputFromID(DONE.monitor_id))
+                    output->onFrameDone(DONE);
+                tab_client_string_free(DONE.monitor_id);
                 break;
             }
             case TabEventType::TAB_EVENT_MONITOR_ADDED: {
                 auto mon = event.data.monitor_added;
-                backend.lock()->log(AQ_LOG_TRACE, std::format("tab backend: Monitor {} added", mon.id));
+                TRACE(backend->log(AQ_LOG_TRACE, std::format("tab backend: Monitor {} added", mon.id)));
                 createOutput(&mon);
                 tab_client_free_monitor_info(&mon);
                 break;
             }
             case TabEventType::TAB_EVENT_MONITOR_REMOVED: {
                 auto mon_id = event.data.monitor_removed;
-                backend.lock()->log(AQ_LOG_TRACE, std::format("tab backend: Monitor {} removed", mon_id));
-                // find and remove the output
-                std::erase_if(outputs, [&](const auto& output) {
-                    if (output->name == mon_id) {
-                        output->destroy();
-                        return true;
-                    }
-                    return false;
-                });
+                TRACE(backend->log(AQ_LOG_TRACE, std::format("tab backend: Monitor {} removed", mon_id)));
+                // destroy() unregisters the output, keep it alive until it's done
+                if (auto output = outputFromID(mon_id))
+                    output->destroy();
                 tab_client_string_free(mon_id);
                 break;
             }
@@ -387,19 +877,10 @@ bool Aquamarine::CTabBackend::dispatchEvents() {
     }
     if (touchDirty && m_pTouch)
         m_pTouch->events.frame.emit();
-    TabFrameTarget target;
-    for(auto& output : outputs)
-        if (tab_client_acquire_frame(m_pClient, output->monitor_id.c_str(), &target) == TAB_ACQUIRE_OK)
-            {
-                output->needsFrame = true;
-                output->events.frame.emit();
-            }
-    return true;
 }
 
 uint32_t Aquamarine::CTabBackend::capabilities() {
-    
-    return 0;
+    return eBackendCapabilities::AQ_BACKEND_CAPABILITY_POINTER;
 }
 
 bool Aquamarine::CTabBackend::setCursor(SP<IBuffer> buffer, const Hyprutils::Math::Vector2D& hotspot) {
@@ -510,10 +991,11 @@ void Aquamarine::CTabBackend::handleInput(TabInputEvent* event,
                 m_pTablet = SP<CTabTablet>(new CTabTablet());
                 backend.lock()->events.newTablet.emit(m_pTablet);
             }
+            if (!m_pTabletTool)
+                m_pTabletTool = SP<CTabTabletTool>(new CTabTabletTool());
             auto& axis = event->data.tablet_tool_axis;
-            auto  tool = SP<CTabTabletTool>(new CTabTabletTool());
             m_pTablet->events.axis.emit(ITablet::SAxisEvent{
-                .tool   = tool,
+                .tool   = m_pTabletTool,
                 .timeMs = (uint32_t)(axis.time_usec / 1000),
                 .absolute = {axis.axes.x, axis.axes.y},
                 .tilt = {axis.axes.tilt_x, axis.axes.tilt_y},
@@ -529,10 +1011,11 @@ void Aquamarine::CTabBackend::handleInput(TabInputEvent* event,
                 m_pTablet = SP<CTabTablet>(new CTabTablet());
                 backend.lock()->events.newTablet.emit(m_pTablet);
             }
+            if (!m_pTabletTool)
+                m_pTabletTool = SP<CTabTabletTool>(new CTabTabletTool());
             auto& proximity = event->data.tablet_tool_proximity;
-            auto  tool      = SP<CTabTabletTool>(new CTabTabletTool());
             m_pTablet->events.proximity.emit(ITablet::SProximityEvent{
-                .tool   = tool,
+                .tool   = m_pTabletTool,
                 .timeMs = (uint32_t)(proximity.time_usec / 1000),
                 .in     = proximity.in_proximity,
             });
@@ -543,10 +1026,11 @@ void Aquamarine::CTabBackend::handleInput(TabInputEvent* event,
                 m_pTablet = SP<CTabTablet>(new CTabTablet());
                 backend.lock()->events.newTablet.emit(m_pTablet);
             }
+            if (!m_pTabletTool)
+                m_pTabletTool = SP<CTabTabletTool>(new CTabTabletTool());
             auto& tip  = event->data.tablet_tool_tip;
-            auto  tool = SP<CTabTabletTool>(new CTabTabletTool());
             m_pTablet->events.tip.emit(ITablet::STipEvent{
-                .tool   = tool,
+                .tool   = m_pTabletTool,
                 .timeMs = (uint32_t)(tip.time_usec / 1000),
                 .down   = tip.state == TAB_TIP_DOWN,
             });
@@ -558,10 +1042,11 @@ void Aquamarine::CTabBackend::handleInput(TabInputEvent* event,
                 m_pTablet = SP<CTabTablet>(new CTabTablet());
                 backend.lock()->events.newTablet.emit(m_pTablet);
             }
+            if (!m_pTabletTool)
+                m_pTabletTool = SP<CTabTabletTool>(new CTabTabletTool());
             auto& button = event->data.tablet_tool_button;
-            auto  tool   = SP<CTabTabletTool>(new CTabTabletTool());
             m_pTablet->events.button.emit(ITablet::SButtonEvent{
-                .tool   = tool,
+                .tool   = m_pTabletTool,
                 .timeMs = (uint32_t)(button.time_usec / 1000),
                 .button = button.button,
                 .down   = button.state == TAB_BUTTON_PRESSED,
@@ -822,7 +1307,62 @@ case TAB_INPUT_KIND_GESTURE_HOLD_END: {
     }
 }
 
+void Aquamarine::CTabBackend::queryFormats() {
+    formats.clear();
+
+    TabFormatModifier* pairs = nullptr;
+    const size_t       count = tab_client_get_formats(m_pClient, &pairs);
+    if (!pairs || count == 0) {
+        backend->log(AQ_LOG_DEBUG, "tab backend: server advertised no formats, falling back to implicit modifiers");
+        return;
+    }
+
+    // what the renderer on the shared drm device can import, if we know
+    std::vector<SDRMFormat> importable;
+    for (const auto& impl : backend->getImplementations()) {
+        if (impl->type() != AQ_BACKEND_DRM || impl->getRenderableFormats().empty())
+            continue;
+        importable = impl->getRenderableFormats();
+        break;
+    }
+
+    auto canImport = [&importable](uint32_t fourcc, uint64_t mod) {
+        if (importable.empty())
+            return true;
+
+        auto fmt = std::ranges::find_if(importable, [fourcc](const auto& f) { return f.drmFormat == fourcc; });
+        return fmt != importable.end() && std::ranges::find(fmt->modifiers, mod) != fmt->modifiers.end();
+    };
+
+    for (size_t i = 0; i < count; ++i) {
+        const auto& PAIR = pairs[i];
+
+        if (!canImport(PAIR.fourcc, PAIR.modifier))
+            continue;
+
+        auto fmt = std::ranges::find_if(formats, [&PAIR](const auto& f) { return f.drmFormat == PAIR.fourcc; });
+        if (fmt == formats.end()) {
+            formats.emplace_back(SDRMFormat{.drmFormat = PAIR.fourcc});
+            fmt = formats.end() - 1;
+        }
+
+        if (std::ranges::find(fmt->modifiers, PAIR.modifier) == fmt->modifiers.end())
+            fmt->modifiers.emplace_back(PAIR.modifier);
+    }
+
+    tab_client_free_formats(pairs, count);
+
+    backend->log(AQ_LOG_DEBUG, std::format("tab backend: negotiated {} formats out of {} advertised format/modifier pairs", formats.size(), count));
+}
+
+std::vector<SDRMFormat> Aquamarine::CTabBackend::getRenderableFormats() {
+    return formats;
+}
+
 std::vector<SDRMFormat> Aquamarine::CTabBackend::getRenderFormats() {
+    if (!formats.empty())
+        return formats;
+
     for (const auto& impl : backend->getImplementations()) {
         if (impl->type() != AQ_BACKEND_DRM || impl->getRenderableFormats().empty())
             continue;
@@ -849,15 +1389,30 @@ std::vector<SDRMFormat> Aquamarine::CTabBackend::getRenderFormats() {
 }
 
 std::vector<SDRMFormat> Aquamarine::CTabBackend::getCursorFormats() {
-    return {};
+    // shm cursors are always accepted, the server uploads them to its cursor plane
+    return {SDRMFormat{.drmFormat = DRM_FORMAT_ARGB8888, .modifiers = {DRM_FORMAT_MOD_LINEAR}}};
+}
+
+SP<CTabOutput> Aquamarine::CTabBackend::outputFromID(std::string_view id) {
+    auto it = outputsByID.find(id);
+    if (it == outputsByID.end())
+        return nullptr;
+    return it->second.lock();
 }
 
 bool Aquamarine::CTabBackend::createOutput(const TabMonitorInfo* monitor_info) {
+    if (outputFromID(monitor_info->id)) {
+        backend->log(AQ_LOG_WARNING, std::format("tab backend: Monitor {} already has an output, ignoring", monitor_info->id));
+        return false;
+    }
+
     auto output = SP<CTabOutput>(new CTabOutput(*monitor_info, self));
     output->self = output;
     outputs.emplace_back(output);
+    outputsByID.emplace(output->monitor_id, output);
 
     backend.lock()->events.newOutput.emit(output);
+    output->scheduleFrame(IOutput::AQ_SCHEDULE_NEW_MONITOR);
 
     return true;
 }
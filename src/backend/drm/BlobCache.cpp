@@ -0,0 +1,141 @@
+#include "BlobCache.hpp"
+#include "Shared.hpp"
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <string_view>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+using namespace Aquamarine;
+using namespace Hyprutils::Memory;
+#define SP CSharedPointer
+
+// luts can get big and there is usually one per crtc, keep a few spare
+constexpr size_t MAX_IDLE_BLOBS = 16;
+
+static size_t hashKey(CDRMBlobCache::eBlobKind kind, std::span<const uint8_t> key) {
+    return std::hash<std::string_view>{}(std::string_view{(const char*)key.data(), key.size()}) ^ (kind * 0x9e3779b97f4a7c15ULL);
+}
+
+Aquamarine::CDRMBlobCache::CDRMBlobCache(CWeakPointer<CDRMBackend> backend_) : backend(backend_) {
+    ;
+}
+
+Aquamarine::CDRMBlobCache::~CDRMBlobCache() {
+    clear();
+}
+
+uint32_t Aquamarine::CDRMBlobCache::acquire(eBlobKind kind, const void* data, size_t len) {
+    const std::span<const uint8_t> KEY{(const uint8_t*)data, len};
+    return acquire(kind, KEY, [KEY] { return std::vector<uint8_t>{KEY.begin(), KEY.end()}; });
+}
+
+uint32_t Aquamarine::CDRMBlobCache::acquire(eBlobKind kind, std::span<const uint8_t> key, const std::function<std::vector<uint8_t>()>& payload) {
+    const auto HASH = hashKey(kind, key);
+
+    for (auto [it, end] = byHash.equal_range(HASH); it != end; ++it) {
+        const auto& BLOB = blobs.at(it->second);
+        if (BLOB.kind != kind || BLOB.key.size() != key.size() || memcmp(BLOB.key.data(), key.data(), key.size()) != 0)
+            continue;
+
+        stats.hits++;
+        TRACE(backend->log(AQ_LOG_TRACE, std::format("drm: blob cache hit, blob {} ({} hits, {} misses)", BLOB.id, stats.hits, stats.misses)));
+
+        ref(BLOB.id);
+        return BLOB.id;
+    }
+
+    stats.misses++;
+
+    const auto ID = create(payload());
+    if (!ID)
+        return 0;
+
+    TRACE(backend->log(AQ_LOG_TRACE, std::format("drm: blob cache miss, created blob {} ({} hits, {} misses)", ID, stats.hits, stats.misses)));
+
+    blobs.emplace(ID, SBlob{.id = ID, .hash = HASH, .kind = kind, .key = {key.begin(), key.end()}, .refs = 1});
+    byHash.emplace(HASH, ID);
+
+    return ID;
+}
+
+void Aquamarine::CDRMBlobCache::ref(uint32_t id) {
+    auto it = blobs.find(id);
+    if (it == blobs.end())
+        return;
+
+    if (it->second.refs++ == 0)
+        std::erase(idle, id);
+}
+
+void Aquamarine::CDRMBlobCache::unref(uint32_t id) {
+    if (!id)
+        return;
+
+    auto it = blobs.find(id);
+    if (it == blobs.end()) {
+        destroy(id);
+        return;
+    }
+
+    if (it->second.refs == 0) {
+        backend->log(AQ_LOG_ERROR, std::format("drm: blob cache: unref on an unreferenced blob {}", id));
+        return;
+    }
+
+    if (--it->second.refs > 0)
+        return;
+
+    idle.emplace_back(id);
+    trimIdle();
+}
+
+void Aquamarine::CDRMBlobCache::clear() {
+    if (!blobs.empty() && backend)
+        backend->log(AQ_LOG_DEBUG, std::format("drm: blob cache: dropping {} blobs", blobs.size()));
+
+    for (auto const& [id, blob] : blobs) {
+        destroy(id);
+    }
+
+    blobs.clear();
+    byHash.clear();
+    idle.clear();
+}
+
+uint32_t Aquamarine::CDRMBlobCache::create(const std::vector<uint8_t>& payload) {
+    uint32_t id = 0;
+    if (drmModeCreatePropertyBlob(backend->gpu->fd, payload.data(), payload.size(), &id)) {
+        backend->log(AQ_LOG_ERROR, "drm: blob cache: failed to create a blob");
+        return 0;
+    }
+
+    return id;
+}
+
+void Aquamarine::CDRMBlobCache::destroy(uint32_t id) {
+    if (!backend || !backend->gpu)
+        return;
+
+    if (drmModeDestroyPropertyBlob(backend->gpu->fd, id))
+        backend->log(AQ_LOG_ERROR, "drm: blob cache: failed to destroy a blob");
+}
+
+void Aquamarine::CDRMBlobCache::trimIdle() {
+    while (idle.size() > MAX_IDLE_BLOBS) {
+        const auto ID = idle.front();
+        idle.pop_front();
+
+        auto it = blobs.find(ID);
+        for (auto [h, end] = byHash.equal_range(it->second.hash); h != end; ++h) {
+            if (h->second == ID) {
+                byHash.erase(h);
+                break;
+            }
+        }
+
+        blobs.erase(it);
+        destroy(ID);
+    }
+}
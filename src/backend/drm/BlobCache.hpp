@@ -0,0 +1,63 @@
+#pragma once
+
+#include <aquamarine/backend/DRM.hpp>
+#include <functional>
+#include <list>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace Aquamarine {
+
+    /*
+        Property blobs are immutable, so commits with the same mode, gamma lut, ctm or hdr metadata
+        can share one. Blobs are looked up by their content and refcounted by whoever holds their id:
+        the crtc / connector state, and commits in flight. Unreferenced blobs are kept for a while,
+        so flipping between a handful of states doesn't create any.
+    */
+    class CDRMBlobCache {
+      public:
+        CDRMBlobCache(Hyprutils::Memory::CWeakPointer<CDRMBackend> backend_);
+        ~CDRMBlobCache();
+
+        enum eBlobKind : uint8_t {
+            AQ_DRM_BLOB_MODE = 0,
+            AQ_DRM_BLOB_LUT,
+            AQ_DRM_BLOB_CTM,
+            AQ_DRM_BLOB_HDR_METADATA,
+        };
+
+        // returns a referenced blob with the given content, 0 on failure
+        uint32_t acquire(eBlobKind kind, const void* data, size_t len);
+        // same, but the content is only built by payload() on a miss. key has to identify it.
+        uint32_t acquire(eBlobKind kind, std::span<const uint8_t> key, const std::function<std::vector<uint8_t>()>& payload);
+
+        void     ref(uint32_t id);
+        void     unref(uint32_t id); // ids we don't know are destroyed right away
+
+        // destroys every blob, ids handed out before are invalid afterwards
+        void clear();
+
+      private:
+        struct SBlob {
+            uint32_t             id   = 0;
+            size_t               hash = 0;
+            eBlobKind            kind = AQ_DRM_BLOB_MODE;
+            std::vector<uint8_t> key;
+            size_t               refs = 0;
+        };
+
+        uint32_t                                     create(const std::vector<uint8_t>& payload);
+        void                                         destroy(uint32_t id);
+        void                                         trimIdle();
+
+        Hyprutils::Memory::CWeakPointer<CDRMBackend> backend;
+        std::unordered_map<uint32_t, SBlob>          blobs;  // by blob id
+        std::unordered_multimap<size_t, uint32_t>    byHash; // content hash -> blob id
+        std::list<uint32_t>                          idle;   // unreferenced blobs, oldest first
+
+        struct {
+            uint64_t hits = 0, misses = 0;
+        } stats;
+    };
+};
@@ -15,6 +15,8 @@
 #include <filesystem>
 #include <system_error>
 #include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 #include <fcntl.h>
 
 extern "C" {
@@ -33,12 +35,36 @@ extern "C" {
 #include "Shared.hpp"
 #include "hwdata.hpp"
 #include "Renderer.hpp"
+#include "BlobCache.hpp"
+#include "FBCache.hpp"
 
 using namespace Aquamarine;
 using namespace Hyprutils::Memory;
 using namespace Hyprutils::Math;
 #define SP CSharedPointer
 
+// enough for a triple-buffered mgpu swapchain, older buffers get a full blit
+constexpr size_t MGPU_DAMAGE_RING = 4;
+// in mailbox mode the mgpu swapchain can have a buffer on screen, one flipping and one queued, plus the blit target
+constexpr size_t MGPU_MAILBOX_LENGTH = 4;
+// a compositor probes a handful of configurations, more than this and we start over
+constexpr size_t MAX_TEST_CACHE = 64;
+
+// late frames: the margin starts at 1ms, grows by 1ms per missed vblank and shrinks by 100us per hit
+constexpr uint64_t LATE_FRAME_MARGIN_MIN   = 1000000;
+constexpr uint64_t LATE_FRAME_MARGIN_STEP  = 1000000;
+constexpr uint64_t LATE_FRAME_MARGIN_DECAY = 100000;
+// cursor-only commits go out this long before the vblank, the kernel still has to latch them
+constexpr uint64_t CURSOR_LATCH_MARGIN = 1500000;
+// docks send a burst of udev change events, one per connector or property
+constexpr uint64_t HOTPLUG_DEBOUNCE = 10000000;
+
+static uint64_t monotonicNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
 Aquamarine::CDRMBackend::CDRMBackend(SP<CBackend> backend_) : backend(backend_) {
     listeners.sessionActivate = backend->session->events.changeActive.listen([this] {
         if (backend->session->active) {
@@ -90,6 +116,33 @@ static int gpuNumBuiltinPanels(const SP<CSessionDevice> gpu) {
     return num;
 }
 
+// Forcing a probe of every connector is what makes bringing a gpu up slow (edid reads over ddc, link training).
+// Only libdrm calls on the gpu's own fd, so each gpu can be probed on a thread of its own.
+static std::unordered_map<uint32_t, drmModeConnector*> probeConnectors(int fd) {
+    std::unordered_map<uint32_t, drmModeConnector*> result;
+
+    auto                                            resources = drmModeGetResources(fd);
+    if (!resources)
+        return result;
+
+    for (int i = 0; i < resources->count_connectors; ++i) {
+        if (auto conn = drmModeGetConnector(fd, resources->connectors[i]))
+            result.emplace(resources->connectors[i], conn);
+    }
+
+    drmModeFreeResources(resources);
+
+    return result;
+}
+
+static void freeProbedConnectors(std::unordered_map<uint32_t, drmModeConnector*>& connectors) {
+    for (auto const& [id, conn] : connectors) {
+        drmModeFreeConnector(conn);
+    }
+
+    connectors.clear();
+}
+
 static std::vector<SP<CSessionDevice>> scanGPUs(SP<CBackend> backend) {
     auto enumerate = enumDRMCards(backend->session->udevHandle);
 
@@ -308,10 +361,42 @@ std::vector<SP<CDRMBackend>> Aquamarine::CDRMBackend::attempt(SP<CBackend> backe
 
     backend->log(AQ_LOG_DEBUG, std::format("drm: Found {} GPUs", gpus.size()));
 
+    // Probe all gpus at once, the rest of the bring-up shares state between them and stays on this thread.
+    std::vector<std::unordered_map<uint32_t, drmModeConnector*>> probed(gpus.size());
+    std::vector<uint64_t>                                        probeTimes(gpus.size());
+    {
+        const auto               START = monotonicNs();
+        std::vector<std::thread> workers;
+
+        for (size_t i = 0; i < gpus.size(); ++i) {
+            auto probe = [&probed, &probeTimes, i, fd = gpus.at(i)->fd] {
+                const auto BEGIN = monotonicNs();
+                probed.at(i)     = probeConnectors(fd);
+                probeTimes.at(i) = monotonicNs() - BEGIN;
+            };
+
+            try {
+                workers.emplace_back(probe);
+            } catch (const std::system_error& e) {
+                backend->log(AQ_LOG_WARNING, std::format("drm: Couldn't start a thread to probe {}, probing inline: {}", gpus.at(i)->path, e.what()));
+                probe();
+            }
+        }
+
+        for (auto& w : workers) {
+            w.join();
+        }
+
+        backend->log(AQ_LOG_DEBUG, std::format("drm: Probed connectors of {} GPUs in {:.2f}ms", gpus.size(), (monotonicNs() - START) / 1000000.0));
+    }
+
     std::vector<SP<CDRMBackend>> backends;
     SP<CDRMBackend>              newPrimary;
 
-    for (auto const& gpu : gpus) {
+    for (size_t i = 0; i < gpus.size(); ++i) {
+        const auto& gpu   = gpus.at(i);
+        const auto  START = monotonicNs();
+
         auto drmBackend  = SP<CDRMBackend>(new CDRMBackend(backend));
         drmBackend->self = drmBackend;
 
@@ -338,6 +423,7 @@ std::vector<SP<CDRMBackend>> Aquamarine::CDRMBackend::attempt(SP<CBackend> backe
 
         drmBackend->grabFormats();
 
+        drmBackend->probedConnectors = std::exchange(probed.at(i), {});
         drmBackend->recheckOutputs();
 
         if (!newPrimary) {
@@ -351,6 +437,14 @@ std::vector<SP<CDRMBackend>> Aquamarine::CDRMBackend::attempt(SP<CBackend> backe
 
         // so that session can handle udev change/remove events for this gpu
         backend->session->sessionDevices.push_back(gpu);
+
+        backend->log(AQ_LOG_DEBUG,
+                     std::format("drm: gpu {} up in {:.2f}ms, after {:.2f}ms probing connectors", gpu->path, (monotonicNs() - START) / 1000000.0, probeTimes.at(i) / 1000000.0));
+    }
+
+    // gpus that failed to come up
+    for (auto& p : probed) {
+        freeProbedConnectors(p);
     }
 
     return backends;
@@ -362,10 +456,16 @@ Aquamarine::CDRMBackend::~CDRMBackend() {
         conn.reset();
     }
 
-    rendererState.allocator->destroyBuffers();
+    if (rendererState.allocator)
+        rendererState.allocator->destroyBuffers();
+
+    freeProbedConnectors(probedConnectors);
 
     rendererState.renderer.reset();
     rendererState.allocator.reset();
+
+    if (timerFD >= 0)
+        close(timerFD);
 }
 
 void Aquamarine::CDRMBackend::log(eBackendLogLevel l, const std::string& s) {
@@ -379,19 +479,26 @@ bool Aquamarine::CDRMBackend::sessionActive() {
 void Aquamarine::CDRMBackend::restoreAfterVT() {
     backend->log(AQ_LOG_DEBUG, "drm: Restoring after VT switch");
 
+    const auto START = monotonicNs();
+
     recheckOutputs();
 
+    const auto RESCANNED = monotonicNs();
+
     backend->log(AQ_LOG_DEBUG, "drm: Rescanned connectors");
 
-    if (!impl->reset())
-        backend->log(AQ_LOG_ERROR, "drm: failed reset");
+    invalidateTestCaches();
 
-    std::vector<SP<SDRMConnector>> noMode;
+    std::vector<SP<SDRMConnector>>                                     noMode;
+    std::vector<std::pair<SP<SDRMConnector>, SDRMConnectorCommitData>> restoring;
 
     for (auto const& c : connectors) {
         if (!c->crtc || !c->output)
             continue;
 
+        // its flip is never coming
+        c->output->discardMailbox();
+
         auto&                   STATE = c->output->state->state();
 
         SDRMConnectorCommitData data = {
@@ -439,10 +546,64 @@ void Aquamarine::CDRMBackend::restoreAfterVT() {
                      std::format("drm: Restoring crtc {} with clock {} hdisplay {} vdisplay {} vrefresh {}", c->crtc->id, data.modeInfo.clock, data.modeInfo.hdisplay,
                                  data.modeInfo.vdisplay, data.modeInfo.vrefresh));
 
-        if (!impl->commit(c, data))
-            backend->log(AQ_LOG_ERROR, std::format("drm: crtc {} failed restore", c->crtc->id));
+        restoring.emplace_back(c, data);
+    }
+
+    // Fbs and blobs belong to our fd, they survived the switch. Put everything back in one modeset
+    // instead of blanking all outputs and bringing them back one by one.
+    bool combined = false, resetOk = false;
+    if (atomic && !restoring.empty()) {
+        auto                                                                datas = restoring;
+        std::vector<std::pair<SP<SDRMConnector>, SDRMConnectorCommitData*>> conns;
+        for (auto& [c, data] : datas) {
+            conns.emplace_back(c, &data);
+        }
+
+        combined = ((CDRMAtomicImpl*)impl.get())->restore(conns);
+
+        if (!combined)
+            backend->log(AQ_LOG_ERROR, "drm: Restoring all outputs in one commit failed, falling back to one by one");
+    }
+
+    if (!combined) {
+        // someone else had the device, don't trust what we learned about buffers or commits before
+        fbCache->clear();
+
+        resetOk = impl->reset();
+        if (!resetOk)
+            backend->log(AQ_LOG_ERROR, "drm: failed reset");
+        else {
+            // nothing references our blobs anymore, start over
+            blobCache->clear();
+
+            for (auto const& crtc : crtcs) {
+                crtc->atomic.modeID     = 0;
+                crtc->atomic.gammaLut   = 0;
+                crtc->atomic.degammaLut = 0;
+                crtc->atomic.ctm        = 0;
+            }
+
+            for (auto const& c : connectors) {
+                c->atomic.hdrBlob = 0;
+            }
+        }
+
+        for (auto& [c, data] : restoring) {
+            if (!impl->commit(c, data))
+                backend->log(AQ_LOG_ERROR, std::format("drm: crtc {} failed restore", c->crtc->id));
+        }
     }
 
+    // both the combined restore and the reset turned every overlay off
+    if (atomic && (combined || resetOk))
+        releaseOverlays();
+
+    const auto DONE = monotonicNs();
+
+    backend->log(AQ_LOG_DEBUG,
+                 std::format("drm: Restored {} outputs on {} in {:.2f}ms ({:.2f}ms rescanning, {:.2f}ms committing {})", restoring.size(), gpuName, (DONE - START) / 1000000.0,
+                             (RESCANNED - START) / 1000000.0, (DONE - RESCANNED) / 1000000.0, combined ? "at once" : "one by one"));
+
     for (auto const& c : noMode) {
         if (!c->output)
             continue;
@@ -592,6 +753,40 @@ bool Aquamarine::CDRMBackend::initResources() {
     drmModeFreePlaneResources(planeResources);
     drmModeFreeResources(resources);
 
+    for (auto const& crtc : crtcs) {
+        std::ranges::stable_sort(crtc->overlays, [](const auto& a, const auto& b) { return a->zpos < b->zpos; });
+
+        // layers are assigned assuming the primary is below every overlay. Drop the overlays that can't go above it,
+        // and give the ones that can be moved a zpos above it, in the same order.
+        if (crtc->primary && crtc->primary->props.values.zpos) {
+            std::vector<SP<SDRMPlane>> above;
+            uint64_t                   below = crtc->primary->zpos;
+
+            for (auto const& p : crtc->overlays) {
+                if (!p->props.values.zpos) {
+                    above.emplace_back(p);
+                    continue;
+                }
+
+                const uint64_t ZPOS = p->zposMutable ? std::max(below + 1, p->zposMin) : p->zpos;
+                if (ZPOS <= below || (p->zposMutable && ZPOS > p->zposMax)) {
+                    backend->log(AQ_LOG_DEBUG, std::format("drm: overlay plane {} can't go above the primary of crtc {}, not using it", p->id, crtc->id));
+                    continue;
+                }
+
+                if (p->zposMutable)
+                    crtc->overlayZpos.emplace_back(p->id, ZPOS);
+
+                below = ZPOS;
+                above.emplace_back(p);
+            }
+
+            crtc->overlays = std::move(above);
+        }
+
+        backend->log(AQ_LOG_DEBUG, std::format("drm: crtc {} has {} overlay planes", crtc->id, crtc->overlays.size()));
+    }
+
     return true;
 }
 
@@ -600,6 +795,13 @@ bool Aquamarine::CDRMBackend::shouldBlit() {
 }
 
 bool Aquamarine::CDRMBackend::initMgpu() {
+    if (rendererState.attempted)
+        return !!rendererState.renderer;
+
+    rendererState.attempted = true;
+
+    const auto        START = monotonicNs();
+
     SP<CGBMAllocator> newAllocator;
     if (primary || backend->primaryAllocator->type() != AQ_ALLOCATOR_TYPE_GBM) {
         newAllocator            = CGBMAllocator::create(backend->reopenDRMNode(gpu->fd), backend);
@@ -625,6 +827,8 @@ bool Aquamarine::CDRMBackend::initMgpu() {
 
     buildGlFormats(rendererState.renderer->formats);
 
+    backend->log(AQ_LOG_DEBUG, std::format("drm: Renderer for {} up in {:.2f}ms", gpuName, (monotonicNs() - START) / 1000000.0));
+
     return true;
 }
 
@@ -655,10 +859,18 @@ void Aquamarine::CDRMBackend::recheckCRTCs() {
 
     backend->log(AQ_LOG_DEBUG, "drm: Rechecking CRTCs");
 
-    std::vector<SP<SDRMConnector>> recheck, changed;
+    invalidateTestCaches();
+
+    // slot -> connected connector on that crtc. What's bound now is the starting point, nobody loses their crtc below.
+    std::vector<SP<SDRMConnector>> owner(crtcs.size()), recheck;
     for (auto const& c : connectors) {
-        if (c->crtc && c->status == DRM_MODE_CONNECTED) {
+        if (c->status != DRM_MODE_CONNECTED)
+            continue;
+
+        const auto SLOT = std::ranges::find(crtcs, c->crtc) - crtcs.begin();
+        if (c->crtc && SLOT < (long)crtcs.size() && !owner.at(SLOT)) {
             backend->log(AQ_LOG_DEBUG, std::format("drm: Skipping connector {}, has crtc {} and is connected", c->szName, c->crtc->id));
+            owner.at(SLOT) = c;
             continue;
         }
 
@@ -666,50 +878,79 @@ void Aquamarine::CDRMBackend::recheckCRTCs() {
         backend->log(AQ_LOG_DEBUG, std::format("drm: connector {}, has crtc {}, will be rechecked", c->szName, c->crtc ? (int)c->crtc->id : -1));
     }
 
-    for (size_t i = 0; i < crtcs.size(); ++i) {
-        bool taken = false;
-        for (auto const& c : connectors) {
-            if (c->crtc != crtcs.at(i))
-                continue;
+    // Every connector left gets the shortest augmenting path: a free crtc it can drive, or one freed up by moving
+    // as few outputs as possible onto other crtcs they can drive. Taking slots in order can leave a display with a
+    // restrictive possibleCrtcs mask without a crtc when a shuffle would fit everyone.
+    for (auto const& c : recheck) {
+        std::vector<int>                               from(crtcs.size(), -2); // slot whose owner would move here, -1 for c
+        std::deque<std::pair<SP<SDRMConnector>, int>> queue = {{c, -1}};
+        int                                            found = -1;
 
-            if (c->status != DRM_MODE_CONNECTED)
-                continue;
+        while (!queue.empty() && found < 0) {
+            auto [conn, slot] = queue.front();
+            queue.pop_front();
 
-            backend->log(AQ_LOG_DEBUG, std::format("drm: slot {} crtc {} taken by {}, skipping", i, c->crtc->id, c->szName));
-            taken = true;
-            break;
+            for (size_t i = 0; i < crtcs.size(); ++i) {
+                if (!(conn->possibleCrtcs & (1 << i)) || from.at(i) != -2)
+                    continue;
+
+                from.at(i) = slot;
+
+                if (!owner.at(i)) {
+                    found = i;
+                    break;
+                }
+
+                queue.emplace_back(owner.at(i), i);
+            }
         }
 
-        if (taken)
+        if (found < 0) {
+            backend->log(AQ_LOG_DEBUG, std::format("drm: No crtc left for connector {}", c->szName));
             continue;
+        }
 
-        bool assigned = false;
-
-        // try to use a connected connector
-        for (auto const& c : recheck) {
-            if (!(c->possibleCrtcs & (1 << i)))
-                continue;
+        for (int i = found; i != -1; i = from.at(i)) {
+            owner.at(i) = from.at(i) == -1 ? c : owner.at(from.at(i));
+        }
+    }
 
-            if (c->status != DRM_MODE_CONNECTED)
-                continue;
+    // outputs that move have to come off their old crtc first, all in one modeset
+    std::vector<SP<IOutput>> disabling;
+    for (size_t i = 0; i < crtcs.size(); ++i) {
+        const auto& c = owner.at(i);
+        if (!c || !c->crtc || c->crtc == crtcs.at(i) || !c->output || !c->output->state || !c->output->state->state().enabled)
+            continue;
 
-            // deactivate old output
-            if (c->output && c->output->state && c->output->state->state().enabled) {
-                c->output->state->setEnabled(false);
-                c->output->commit();
-            }
+        c->output->state->setEnabled(false);
+        disabling.emplace_back(c->output);
+    }
 
-            backend->log(AQ_LOG_DEBUG,
-                         std::format("drm: connected slot {} crtc {} assigned to {}{}", i, crtcs.at(i)->id, c->szName, c->crtc ? std::format(" (old {})", c->crtc->id) : ""));
-            c->crtc  = crtcs.at(i);
-            assigned = true;
-            changed.emplace_back(c);
-            std::erase(recheck, c);
-            break;
+    if (!disabling.empty() && (!atomic || !commitOutputs(disabling))) {
+        for (auto const& o : disabling) {
+            o->commit();
         }
+    }
 
-        if (!assigned)
+    std::vector<SP<SDRMConnector>> changed;
+    for (size_t i = 0; i < crtcs.size(); ++i) {
+        const auto& c = owner.at(i);
+        if (!c) {
             backend->log(AQ_LOG_DEBUG, std::format("drm: slot {} crtc {} unassigned", i, crtcs.at(i)->id));
+            continue;
+        }
+
+        if (c->crtc == crtcs.at(i))
+            continue;
+
+        backend->log(AQ_LOG_DEBUG,
+                     std::format("drm: connected slot {} crtc {} assigned to {}{}", i, crtcs.at(i)->id, c->szName, c->crtc ? std::format(" (old {})", c->crtc->id) : ""));
+
+        if (c->crtc && c->output)
+            changed.emplace_back(c);
+
+        c->crtc = crtcs.at(i);
+        c->recheckCRTCProps();
     }
 
     for (auto const& c : connectors) {
@@ -717,13 +958,18 @@ void Aquamarine::CDRMBackend::recheckCRTCs() {
             continue;
 
         backend->log(AQ_LOG_DEBUG, std::format("drm: Connector {} is not connected{}", c->szName, c->crtc ? std::format(", removing old crtc {}", c->crtc->id) : ""));
+
+        // someone else may be driving it now
+        c->crtc = nullptr;
     }
 
-    // tell the user to re-assign a valid mode etc, if needed
+    // tell the user to re-assign a valid mode etc, the outputs that moved are off
     for (auto const& conn : changed) {
-        if (conn->status != DRM_MODE_CONNECTED && conn->output)
+        if (conn->output)
             conn->output->events.state.emit(IOutput::SStateEvent{});
     }
+
+    backend->log(AQ_LOG_DEBUG, std::format("drm: CRTCs rechecked, {} outputs moved", changed.size()));
 }
 
 bool Aquamarine::CDRMBackend::grabFormats() {
@@ -732,8 +978,14 @@ bool Aquamarine::CDRMBackend::grabFormats() {
 }
 
 bool Aquamarine::CDRMBackend::registerGPU(SP<CSessionDevice> gpu_, SP<CDRMBackend> primary_) {
-    gpu     = gpu_;
-    primary = primary_;
+    gpu       = gpu_;
+    primary   = primary_;
+    blobCache = makeShared<CDRMBlobCache>(self);
+    fbCache   = makeShared<CDRMFBCache>(self);
+
+    timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timerFD < 0)
+        backend->log(AQ_LOG_ERROR, "drm: failed to create a timerfd, late frames and hotplug debouncing are off");
 
     auto drmName = drmGetDeviceNameFromFd2(gpu->fd);
     auto drmVer  = drmGetVersion(gpu->fd);
@@ -752,8 +1004,8 @@ bool Aquamarine::CDRMBackend::registerGPU(SP<CSessionDevice> gpu_, SP<CDRMBacken
 
     listeners.gpuChange = gpu->events.change.listen([this](const CSessionDevice::SChangeEvent& E) {
         if (E.type == CSessionDevice::AQ_SESSION_EVENT_CHANGE_HOTPLUG) {
-            backend->log(AQ_LOG_DEBUG, std::format("drm: Got a hotplug event for {}", gpuName));
-            recheckOutputs();
+            backend->log(AQ_LOG_DEBUG, std::format("drm: Got a hotplug event for {}, connector {}", gpuName, E.hotplug.connectorID));
+            queueHotplug(E);
         } else if (E.type == CSessionDevice::AQ_SESSION_EVENT_CHANGE_LEASE) {
             backend->log(AQ_LOG_DEBUG, std::format("drm: Got a lease event for {}", gpuName));
             scanLeases();
@@ -772,6 +1024,54 @@ eBackendType Aquamarine::CDRMBackend::type() {
     return eBackendType::AQ_BACKEND_DRM;
 }
 
+void Aquamarine::CDRMBackend::invalidateTestCaches() {
+    for (auto const& c : connectors) {
+        if (c->output)
+            c->output->invalidateTestCache();
+    }
+}
+
+void Aquamarine::CDRMBackend::releaseOverlays() {
+    std::vector<uint32_t> hadOverlays;
+
+    for (auto const& plane : planes) {
+        if (plane->type != DRM_PLANE_TYPE_OVERLAY)
+            continue;
+
+        if (plane->overlayCrtc)
+            hadOverlays.emplace_back(plane->overlayCrtc);
+
+        // nothing scans these out anymore, and no flip is coming to rotate them out
+        std::vector<IBuffer*> released;
+        for (auto const& fb : {plane->front, plane->back, plane->last}) {
+            if (!fb || !fb->buffer || std::ranges::find(released, fb->buffer.get()) != released.end())
+                continue;
+
+            released.emplace_back(fb->buffer.get());
+            fb->buffer->lockedByBackend = false;
+            fb->buffer->events.backendRelease.emit();
+        }
+
+        plane->front       = nullptr;
+        plane->back        = nullptr;
+        plane->last        = nullptr;
+        plane->overlayCrtc = 0;
+    }
+
+    for (auto const& c : connectors) {
+        if (!c->output || !c->crtc)
+            continue;
+
+        const bool HAD = std::ranges::find(hadOverlays, c->crtc->id) != hadOverlays.end() || !c->output->lastLayerAssignment.empty();
+
+        c->output->lastLayerAssignment.clear();
+
+        // the layers need to be composited or assigned again
+        if (HAD)
+            c->output->events.state.emit(IOutput::SStateEvent{});
+    }
+}
+
 void Aquamarine::CDRMBackend::recheckOutputs() {
     scanConnectors();
 
@@ -804,12 +1104,93 @@ void Aquamarine::CDRMBackend::recheckOutputs() {
     }
 }
 
+bool Aquamarine::CDRMBackend::recheckConnector(uint32_t id) {
+    auto it = std::ranges::find_if(connectors, [id](const auto& e) { return e->id == id; });
+    if (it == connectors.end())
+        return false;
+
+    // gone, e.g. an mst port
+    auto drmConn = drmModeGetConnector(gpu->fd, id);
+    if (!drmConn)
+        return false;
+
+    auto       conn       = *it;
+    const auto OLD_STATUS = conn->status;
+    conn->status          = drmConn->connection;
+
+    // what other outputs tested fine against may not hold with a connector coming or going,
+    // even if no crtc ends up moving
+    if (OLD_STATUS != conn->status)
+        invalidateTestCaches();
+
+    if (conn->crtc)
+        conn->recheckCRTCProps();
+
+    backend->log(AQ_LOG_DEBUG, std::format("drm: Connector {} connection state: {}", id, (int)drmConn->connection));
+
+    if (conn->status != DRM_MODE_CONNECTED && conn->output) {
+        backend->log(AQ_LOG_DEBUG, std::format("drm: Connector {} disconnected", conn->szName));
+        conn->disconnect();
+    }
+
+    // a new output needs a crtc, one that got freed may be wanted by another
+    if (std::ranges::any_of(connectors, [](const auto& c) { return c->status == DRM_MODE_CONNECTED && !c->crtc; }))
+        recheckCRTCs();
+
+    if (conn->status == DRM_MODE_CONNECTED && !conn->output) {
+        backend->log(AQ_LOG_DEBUG, std::format("drm: Connector {} connected", conn->szName));
+        conn->connect(drmConn);
+    }
+
+    drmModeFreeConnector(drmConn);
+    return true;
+}
+
+void Aquamarine::CDRMBackend::queueHotplug(const CSessionDevice::SChangeEvent& event) {
+    if (!event.hotplug.connectorID)
+        pendingHotplug.full = true;
+    else if (std::ranges::find(pendingHotplug.connectors, event.hotplug.connectorID) == pendingHotplug.connectors.end())
+        pendingHotplug.connectors.emplace_back(event.hotplug.connectorID);
+
+    if (timerFD < 0) {
+        dispatchHotplugs();
+        return;
+    }
+
+    // the window starts with the first event, a steady stream of them doesn't hold the rescan back
+    if (pendingHotplug.deadline)
+        return;
+
+    pendingHotplug.deadline = monotonicNs() + HOTPLUG_DEBOUNCE;
+    updateTimer();
+}
+
+void Aquamarine::CDRMBackend::dispatchHotplugs() {
+    auto ids  = std::move(pendingHotplug.connectors);
+    bool full = pendingHotplug.full;
+
+    pendingHotplug = {};
+
+    for (auto const& id : ids) {
+        if (full)
+            break;
+
+        full = !recheckConnector(id);
+    }
+
+    backend->log(AQ_LOG_DEBUG, std::format("drm: Handled hotplugs for {}: {} targeted{}", gpuName, ids.size(), full ? ", full rescan" : ""));
+
+    if (full)
+        recheckOutputs();
+}
+
 void Aquamarine::CDRMBackend::scanConnectors() {
     backend->log(AQ_LOG_DEBUG, std::format("drm: Scanning connectors for {}", gpu->path));
 
     auto resources = drmModeGetResources(gpu->fd);
     if (!resources) {
         backend->log(AQ_LOG_ERROR, std::format("drm: Scanning connectors for {} failed", gpu->path));
+        freeProbedConnectors(probedConnectors);
         return;
     }
 
@@ -817,7 +1198,12 @@ void Aquamarine::CDRMBackend::scanConnectors() {
         uint32_t          connectorID = resources->connectors[i];
 
         SP<SDRMConnector> conn;
-        auto              drmConn = drmModeGetConnector(gpu->fd, connectorID);
+        drmModeConnector* drmConn = nullptr;
+
+        if (auto probed = probedConnectors.extract(connectorID))
+            drmConn = probed.mapped();
+        else
+            drmConn = drmModeGetConnector(gpu->fd, connectorID);
 
         backend->log(AQ_LOG_DEBUG, std::format("drm: Scanning connector id {}", connectorID));
 
@@ -864,6 +1250,9 @@ void Aquamarine::CDRMBackend::scanConnectors() {
     });
 
     drmModeFreeResources(resources);
+
+    // any left over are gone by now
+    freeProbedConnectors(probedConnectors);
 }
 
 void Aquamarine::CDRMBackend::scanLeases() {
@@ -913,7 +1302,65 @@ bool Aquamarine::CDRMBackend::start() {
 }
 
 std::vector<Hyprutils::Memory::CSharedPointer<SPollFD>> Aquamarine::CDRMBackend::pollFDs() {
-    return {makeShared<SPollFD>(gpu->fd, [this]() { dispatchEvents(); })};
+    if (timerFD < 0)
+        return {makeShared<SPollFD>(gpu->fd, [this]() { dispatchEvents(); })};
+
+    return {makeShared<SPollFD>(gpu->fd, [this]() { dispatchEvents(); }), makeShared<SPollFD>(timerFD, [this]() { dispatchTimer(); })};
+}
+
+void Aquamarine::CDRMBackend::updateTimer() {
+    if (timerFD < 0)
+        return;
+
+    uint64_t earliest = pendingHotplug.deadline;
+    for (auto const& c : connectors) {
+        if (!c->output)
+            continue;
+
+        for (auto const& deadline : {c->output->lateFrames.deadline, c->output->cursorCommit.deadline}) {
+            if (deadline && (!earliest || deadline < earliest))
+                earliest = deadline;
+        }
+    }
+
+    // all zeroes disarms
+    itimerspec ts = {};
+    if (earliest)
+        ts.it_value = {.tv_sec = (time_t)(earliest / 1000000000ULL), .tv_nsec = (long)(earliest % 1000000000ULL)};
+
+    if (timerfd_settime(timerFD, TFD_TIMER_ABSTIME, &ts, nullptr))
+        backend->log(AQ_LOG_ERROR, std::format("drm: failed to arm the timerfd: {}", strerror(errno)));
+}
+
+void Aquamarine::CDRMBackend::dispatchTimer() {
+    uint64_t expirations = 0;
+    read(timerFD, &expirations, sizeof(expirations));
+
+    const auto NOW = monotonicNs();
+
+    for (auto const& c : connectors) {
+        if (!c->output)
+            continue;
+
+        if (c->output->cursorCommit.deadline && c->output->cursorCommit.deadline <= NOW)
+            c->output->commitCursor();
+
+        if (!c->output->lateFrames.deadline || c->output->lateFrames.deadline > NOW)
+            continue;
+
+        c->output->lateFrames.deadline = 0;
+        c->frameEventScheduled         = false;
+
+        if (c->isPageFlipPending || !c->output->enabledState || !sessionActive())
+            continue;
+
+        c->output->sendFrame(true);
+    }
+
+    if (pendingHotplug.deadline && pendingHotplug.deadline <= NOW)
+        dispatchHotplugs();
+
+    updateTimer();
 }
 
 int Aquamarine::CDRMBackend::drmFD() {
@@ -924,39 +1371,72 @@ int Aquamarine::CDRMBackend::drmRenderNodeFD() {
     return gpu->renderNodeFd;
 }
 
+SP<SDRMConnector> Aquamarine::SDRMPageFlip::connectorFromCRTC(uint32_t crtcID) {
+    if (!backend)
+        return nullptr;
+
+    auto it = std::ranges::find_if(backend->connectors, [crtcID](const auto& c) { return c->crtc && c->crtc->id == crtcID; });
+    return it == backend->connectors.end() ? nullptr : *it;
+}
+
 static void handlePF(int fd, unsigned seq, unsigned tv_sec, unsigned tv_usec, unsigned crtc_id, void* data) {
     auto pageFlip = (SDRMPageFlip*)data;
 
-    if (!pageFlip || !pageFlip->connector)
+    if (!pageFlip)
+        return;
+
+    SP<SDRMConnector> connector = pageFlip->connector.lock();
+
+    // a commitOutputs event. Crtcs that didn't flip a buffer get one too, skip those
+    if (!connector && pageFlip->backend) {
+        connector = pageFlip->connectorFromCRTC(crtc_id);
+        if (connector && !connector->isPageFlipPending)
+            return;
+    }
+
+    if (!connector)
         return;
 
-    pageFlip->connector->isPageFlipPending = false;
+    if (pageFlip->cursorOnly)
+        connector->cursorFlipPending = false;
+    else
+        connector->isPageFlipPending = false;
 
-    const auto& BACKEND = pageFlip->connector->backend;
+    const auto& BACKEND = connector->backend;
 
     TRACE(BACKEND->log(AQ_LOG_TRACE, std::format("drm: pf event seq {} sec {} usec {} crtc {}", seq, tv_sec, tv_usec, crtc_id)));
 
-    if (pageFlip->connector->status != DRM_MODE_CONNECTED || !pageFlip->connector->crtc) {
+    if (connector->status != DRM_MODE_CONNECTED || !connector->crtc) {
         BACKEND->log(AQ_LOG_DEBUG, "drm: Ignoring a pf event from a disabled crtc / connector");
         return;
     }
 
-    pageFlip->connector->onPresent();
+    timespec presented = {.tv_sec = (time_t)tv_sec, .tv_nsec = (long)(tv_usec * 1000)};
 
-    uint32_t flags = IOutput::AQ_OUTPUT_PRESENT_VSYNC | IOutput::AQ_OUTPUT_PRESENT_HW_CLOCK | IOutput::AQ_OUTPUT_PRESENT_HW_COMPLETION | IOutput::AQ_OUTPUT_PRESENT_ZEROCOPY;
+    // nothing new was presented, but frames asked for in the meantime were held back by the flip
+    if (pageFlip->cursorOnly) {
+        connector->afterFlip(presented);
+        if (BACKEND->sessionActive() && connector->output->needsFrame && connector->output->enabledState)
+            connector->output->scheduleFrame(IOutput::AQ_SCHEDULE_NEEDS_FRAME);
+        return;
+    }
 
-    timespec presented = {.tv_sec = (time_t)tv_sec, .tv_nsec = (long)(tv_usec * 1000)};
+    connector->onPresent();
+
+    uint32_t flags = IOutput::AQ_OUTPUT_PRESENT_VSYNC | IOutput::AQ_OUTPUT_PRESENT_HW_CLOCK | IOutput::AQ_OUTPUT_PRESENT_HW_COMPLETION | IOutput::AQ_OUTPUT_PRESENT_ZEROCOPY;
 
-    pageFlip->connector->output->events.present.emit(IOutput::SPresentEvent{
+    connector->output->events.present.emit(IOutput::SPresentEvent{
         .presented = BACKEND->sessionActive(),
         .when      = &presented,
         .seq       = seq,
-        .refresh   = (int)(pageFlip->connector->refresh ? (1000000000000LL / pageFlip->connector->refresh) : 0),
+        .refresh   = (int)(connector->refresh ? (1000000000000LL / connector->refresh) : 0),
         .flags     = flags,
     });
 
-    if (BACKEND->sessionActive() && !pageFlip->connector->frameEventScheduled && pageFlip->connector->output->enabledState)
-        pageFlip->connector->output->events.frame.emit();
+    connector->afterFlip(presented);
+
+    if (BACKEND->sessionActive() && !connector->frameEventScheduled && connector->output->enabledState)
+        connector->frameAfterFlip(presented);
 }
 
 bool Aquamarine::CDRMBackend::dispatchEvents() {
@@ -984,24 +1464,10 @@ bool Aquamarine::CDRMBackend::setCursor(SP<IBuffer> buffer, const Hyprutils::Mat
 void Aquamarine::CDRMBackend::onReady() {
     backend->log(AQ_LOG_DEBUG, std::format("drm: Connectors size2 {}", connectors.size()));
 
-    // init a drm renderer to gather gl formats.
-    // if we are secondary, initMgpu will have done that
-    if (!primary) {
-        auto a = CGBMAllocator::create(backend->reopenDRMNode(gpu->fd), backend);
-        if (!a)
-            backend->log(AQ_LOG_ERROR, "drm: onReady: no renderer for gl formats");
-        else {
-            auto r = CDRMRenderer::attempt(backend.lock(), gpu->renderNodeFd >= 0 ? gpu->renderNodeFd : gpu->fd);
-            if (!r)
-                backend->log(AQ_LOG_ERROR, "drm: onReady: no renderer for gl formats");
-            else {
-                TRACE(backend->log(AQ_LOG_TRACE, std::format("drm: onReady: gathered {} gl formats", r->formats.size())));
-                buildGlFormats(r->formats);
-                r.reset();
-                a.reset();
-            }
-        }
-    }
+    // the primary's renderer is the source of every mgpu blit, and gives us the gl formats.
+    // Secondaries create theirs when they first have to blit, which may be never
+    if (!primary && !initMgpu())
+        backend->log(AQ_LOG_ERROR, "drm: Failed initializing mgpu, no renderer for gl formats");
 
     for (auto const& c : connectors) {
         backend->log(AQ_LOG_DEBUG, std::format("drm: onReady: connector {}", c->id));
@@ -1018,11 +1484,6 @@ void Aquamarine::CDRMBackend::onReady() {
 
         backend->events.newOutput.emit(SP<IOutput>(c->output));
     }
-
-    if (!initMgpu()) {
-        backend->log(AQ_LOG_ERROR, "drm: Failed initializing mgpu");
-        return;
-    }
 }
 
 std::vector<SDRMFormat> Aquamarine::CDRMBackend::getRenderFormats() {
@@ -1037,6 +1498,9 @@ std::vector<SDRMFormat> Aquamarine::CDRMBackend::getRenderFormats() {
 }
 
 std::vector<SDRMFormat> Aquamarine::CDRMBackend::getRenderableFormats() {
+    if (primary)
+        initMgpu();
+
     return glFormats;
 }
 
@@ -1068,33 +1532,118 @@ bool Aquamarine::CDRMBackend::createOutput(const std::string&) {
     return false;
 }
 
-int Aquamarine::CDRMBackend::getNonMasterFD() {
-    int fd = open(gpuName.c_str(), O_RDWR | O_CLOEXEC);
-
-    if (fd < 0) {
-        backend->log(AQ_LOG_ERROR, "drm: couldn't dupe fd for non master");
-        return -1;
+bool Aquamarine::CDRMBackend::commitOutputs(const std::vector<SP<IOutput>>& outputs, bool onlyTest) {
+    if (!atomic) {
+        backend->log(AQ_LOG_ERROR, "drm: commitOutputs requires atomic modesetting");
+        return false;
     }
 
-    if (drmIsMaster(fd) && drmDropMaster(fd) < 0) {
-        backend->log(AQ_LOG_ERROR, "drm: couldn't drop master from duped fd");
-        return -1;
+    if (!sessionActive()) {
+        backend->log(AQ_LOG_ERROR, "drm: Session inactive");
+        return false;
     }
 
-    return fd;
-}
+    std::vector<SP<CDRMOutput>> drmOutputs;
+    for (auto const& o : outputs) {
+        if (!o || o->getBackend().get() != this) {
+            backend->log(AQ_LOG_ERROR, "drm: commitOutputs: output doesn't belong to this backend");
+            return false;
+        }
 
-SP<IAllocator> Aquamarine::CDRMBackend::preferredAllocator() {
-    return backend->primaryAllocator;
-}
+        auto output = ((CDRMOutput*)o.get())->self.lock();
 
-std::vector<SP<IAllocator>> Aquamarine::CDRMBackend::getAllocators() {
-    return {backend->primaryAllocator, dumbAllocator};
-}
+        // a mailbox commit waits for the pending flip on its own, it can't join a transaction
+        if (!onlyTest && output->connector->isPageFlipPending && output->state->state().presentationMode == AQ_OUTPUT_PRESENTATION_MAILBOX) {
+            backend->log(AQ_LOG_ERROR, std::format("drm: commitOutputs: output {} has a page-flip pending, commit it on its own", output->name));
+            return false;
+        }
 
-Hyprutils::Memory::CWeakPointer<IBackendImplementation> Aquamarine::CDRMBackend::getPrimary() {
-    return primary;
-}
+        if (std::ranges::find(drmOutputs, output) == drmOutputs.end())
+            drmOutputs.emplace_back(output);
+    }
+
+    if (drmOutputs.empty())
+        return true;
+
+    std::vector<SDRMConnectorCommitData> data(drmOutputs.size());
+    for (size_t i = 0; i < drmOutputs.size(); ++i) {
+        if (!drmOutputs.at(i)->prepareCommit(onlyTest, data.at(i))) {
+            backend->log(AQ_LOG_ERROR, std::format("drm: commitOutputs: output {} rejected its state", drmOutputs.at(i)->name));
+            return false;
+        }
+
+        // crtcs can't flip async together
+        if (data.at(i).flags & DRM_MODE_PAGE_FLIP_ASYNC) {
+            backend->log(AQ_LOG_ERROR, std::format("drm: commitOutputs: output {} wants an immediate presentation", drmOutputs.at(i)->name));
+            return false;
+        }
+    }
+
+    // we can't go further without a blit
+    if (primary && onlyTest)
+        return true;
+
+    std::vector<std::pair<SP<SDRMConnector>, SDRMConnectorCommitData*>> connectors;
+    for (size_t i = 0; i < drmOutputs.size(); ++i) {
+        connectors.emplace_back(drmOutputs.at(i)->connector, &data.at(i));
+    }
+
+    transactionPageFlip.backend = self;
+
+    const bool ok = ((CDRMAtomicImpl*)impl.get())->commitConnectors(connectors, onlyTest);
+
+    TRACE(backend->log(AQ_LOG_TRACE, std::format("drm: commitOutputs: {} outputs in one request, {}{}", drmOutputs.size(), ok ? "ok" : "failed", onlyTest ? " (test)" : "")));
+
+    for (auto const& [connector, d] : connectors) {
+        if (ok && !onlyTest)
+            connector->applyCommit(*d);
+        else
+            connector->rollbackCommit(*d);
+    }
+
+    if (!ok && !onlyTest) {
+        for (auto const& o : drmOutputs) {
+            o->lastLayerAssignment.clear();
+        }
+    }
+
+    if (onlyTest || !ok)
+        return ok;
+
+    for (size_t i = 0; i < drmOutputs.size(); ++i) {
+        drmOutputs.at(i)->finishCommit(data.at(i));
+    }
+
+    return true;
+}
+
+int Aquamarine::CDRMBackend::getNonMasterFD() {
+    int fd = open(gpuName.c_str(), O_RDWR | O_CLOEXEC);
+
+    if (fd < 0) {
+        backend->log(AQ_LOG_ERROR, "drm: couldn't dupe fd for non master");
+        return -1;
+    }
+
+    if (drmIsMaster(fd) && drmDropMaster(fd) < 0) {
+        backend->log(AQ_LOG_ERROR, "drm: couldn't drop master from duped fd");
+        return -1;
+    }
+
+    return fd;
+}
+
+SP<IAllocator> Aquamarine::CDRMBackend::preferredAllocator() {
+    return backend->primaryAllocator;
+}
+
+std::vector<SP<IAllocator>> Aquamarine::CDRMBackend::getAllocators() {
+    return {backend->primaryAllocator, dumbAllocator};
+}
+
+Hyprutils::Memory::CWeakPointer<IBackendImplementation> Aquamarine::CDRMBackend::getPrimary() {
+    return primary;
+}
 
 bool Aquamarine::SDRMPlane::init(drmModePlane* plane) {
     id = plane->plane_id;
@@ -1105,7 +1654,15 @@ bool Aquamarine::SDRMPlane::init(drmModePlane* plane) {
     if (!getDRMProp(backend->gpu->fd, id, props.values.type, &type))
         return false;
 
-    initialID = id;
+    if (props.values.zpos) {
+        if (!getDRMProp(backend->gpu->fd, id, props.values.zpos, &zpos))
+            zpos = 0;
+
+        zposMutable = !isDRMPropImmutable(backend->gpu->fd, props.values.zpos) && introspectDRMPropRange(backend->gpu->fd, props.values.zpos, &zposMin, &zposMax);
+    }
+
+    initialID     = id;
+    possibleCrtcs = plane->possible_crtcs;
 
     backend->backend->log(AQ_LOG_DEBUG, std::format("drm: Plane {} has type {}", id, (int)type));
 
@@ -1156,6 +1713,11 @@ bool Aquamarine::SDRMPlane::init(drmModePlane* plane) {
             continue;
 
         auto CRTC = backend->crtcs.at(i);
+        if (type == DRM_PLANE_TYPE_OVERLAY) {
+            CRTC->overlays.emplace_back(self.lock());
+            continue;
+        }
+
         if (type == DRM_PLANE_TYPE_PRIMARY && !CRTC->primary) {
             CRTC->primary = self.lock();
             break;
@@ -1170,6 +1732,11 @@ bool Aquamarine::SDRMPlane::init(drmModePlane* plane) {
     return true;
 }
 
+bool Aquamarine::SDRMPlane::supportsFormat(uint32_t drmFormat, uint64_t modifier) const {
+    auto it = std::ranges::find_if(formats, [drmFormat](const auto& f) { return f.drmFormat == drmFormat; });
+    return it != formats.end() && std::ranges::find(it->modifiers, modifier) != it->modifiers.end();
+}
+
 SP<SDRMCRTC> Aquamarine::SDRMConnector::getCurrentCRTC(const drmModeConnector* connector) {
     uint32_t crtcID = 0;
     if (props.values.crtc_id) {
@@ -1211,6 +1778,8 @@ SP<SDRMCRTC> Aquamarine::SDRMConnector::getCurrentCRTC(const drmModeConnector* c
 
 bool Aquamarine::SDRMConnector::init(drmModeConnector* connector) {
     pendingPageFlip.connector = self.lock();
+    cursorPageFlip.connector  = self.lock();
+    cursorPageFlip.cursorOnly = true;
 
     if (!getDRMConnectorProps(backend->gpu->fd, id, &props))
         return false;
@@ -1292,8 +1861,8 @@ IOutput::SParsedEDID Aquamarine::SDRMConnector::parseEDID(std::vector<uint8_t> d
     auto edid       = di_info_get_edid(info);
     auto venProduct = di_edid_get_vendor_product(edid);
     auto pnpID      = std::string{venProduct->manufacturer, 3};
-    if (PNPIDS.contains(pnpID))
-        make = PNPIDS.at(pnpID);
+    if (const auto VENDOR = pnpVendor(pnpID))
+        make = *VENDOR;
     else
         make = pnpID;
 
@@ -1533,6 +2102,21 @@ void Aquamarine::SDRMConnector::applyCommit(const SDRMConnectorCommitData& data)
     if (crtc->cursor && data.cursorFB)
         data.cursorFB->buffer->lockedByBackend = true;
 
+    if (data.overlaysChanged || !data.mainFB || !output->state->state().enabled) {
+        const bool ENABLED = data.mainFB && output->state->state().enabled;
+        for (auto const& plane : crtc->overlays) {
+            auto it = std::ranges::find_if(data.overlays, [&plane](const auto& o) { return o.plane == plane; });
+            if (ENABLED && it != data.overlays.end()) {
+                plane->back                      = it->fb;
+                plane->overlayCrtc               = crtc->id;
+                it->fb->buffer->lockedByBackend = true;
+            } else if (plane->overlayCrtc == crtc->id) {
+                plane->back        = nullptr;
+                plane->overlayCrtc = 0;
+            }
+        }
+    }
+
     pendingCursorFB.reset();
 
     if (output->state->state().committed & COutputState::AQ_OUTPUT_STATE_MODE)
@@ -1553,10 +2137,28 @@ void Aquamarine::SDRMConnector::rollbackCommit(const SDRMConnectorCommitData& da
     crtc->pendingCursor.reset();
 }
 
+void Aquamarine::SDRMConnector::frameAfterFlip(const timespec& presented) {
+    if (output->scheduleLateFrame((uint64_t)presented.tv_sec * 1000000000ULL + presented.tv_nsec))
+        return;
+
+    output->sendFrame();
+}
+
+void Aquamarine::SDRMConnector::afterFlip(const timespec& presented) {
+    // before any cursor-only commit, a queued one carries the cursor anyways
+    output->submitMailbox();
+
+    output->cursorCommit.lastVblank = (uint64_t)presented.tv_sec * 1000000000ULL + presented.tv_nsec;
+
+    if (output->cursorCommit.dirty)
+        output->scheduleCursorCommit();
+}
+
 void Aquamarine::SDRMConnector::onPresent() {
     crtc->primary->last  = crtc->primary->front;
     crtc->primary->front = crtc->primary->back;
-    if (crtc->primary->last && crtc->primary->last->buffer) {
+    // the same buffer committed twice is still on screen
+    if (crtc->primary->last && crtc->primary->last->buffer && crtc->primary->last != crtc->primary->front) {
         crtc->primary->last->buffer->lockedByBackend = false;
         crtc->primary->last->buffer->events.backendRelease.emit();
     }
@@ -1564,17 +2166,32 @@ void Aquamarine::SDRMConnector::onPresent() {
     if (crtc->cursor) {
         crtc->cursor->last  = crtc->cursor->front;
         crtc->cursor->front = crtc->cursor->back;
-        if (crtc->cursor->last && crtc->cursor->last->buffer) {
+        if (crtc->cursor->last && crtc->cursor->last->buffer && crtc->cursor->last != crtc->cursor->front) {
             crtc->cursor->last->buffer->lockedByBackend = false;
             crtc->cursor->last->buffer->events.backendRelease.emit();
         }
     }
+
+    for (auto const& plane : crtc->overlays) {
+        // planes we just released still hold our front buffer
+        if (plane->overlayCrtc != crtc->id && (!plane->front || plane->back))
+            continue;
+
+        plane->last  = plane->front;
+        plane->front = plane->back;
+        if (plane->last && plane->last->buffer && plane->last != plane->front) {
+            plane->last->buffer->lockedByBackend = false;
+            plane->last->buffer->events.backendRelease.emit();
+        }
+    }
 }
 
 Aquamarine::CDRMOutput::~CDRMOutput() {
     if (backend && backend->backend)
         backend->backend->removeIdleEvent(frameIdle);
+    discardMailbox();
     connector->isPageFlipPending   = false;
+    connector->cursorFlipPending   = false;
     connector->frameEventScheduled = false;
 }
 
@@ -1591,7 +2208,7 @@ void Aquamarine::CDRMOutput::setCursorVisible(bool visible) {
     scheduleFrame(AQ_SCHEDULE_CURSOR_VISIBLE);
 }
 
-bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
+bool Aquamarine::CDRMOutput::prepareCommit(bool onlyTest, SDRMConnectorCommitData& data, bool canQueue) {
     if (!backend->backend->session->active) {
         backend->backend->log(AQ_LOG_ERROR, "drm: Session inactive");
         return false;
@@ -1678,7 +2295,12 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
                 backend->backend->log(AQ_LOG_DEBUG, std::format("drm: Disabling output {}", name));
         }
 
-        if (STATE.enabled && (NEEDS_RECONFIG || (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_BUFFER)) && connector->isPageFlipPending) {
+        // in mailbox mode, plain flips wait for the pending one instead, if the caller can queue them. So do flips
+        // behind a cursor-only commit in any mode, blocking ones are held back by the kernel on their own.
+        const bool QUEUEABLE    = canQueue && !NEEDS_RECONFIG && (STATE.presentationMode == AQ_OUTPUT_PRESENTATION_MAILBOX || !connector->isPageFlipPending);
+        const bool FLIP_PENDING = connector->isPageFlipPending || (connector->cursorFlipPending && !BLOCKING);
+
+        if (STATE.enabled && (NEEDS_RECONFIG || (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_BUFFER)) && FLIP_PENDING && !QUEUEABLE) {
             backend->backend->log(AQ_LOG_ERROR, "drm: Cannot commit when a page-flip is awaiting");
             return false;
         }
@@ -1689,19 +2311,24 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
             flags |= DRM_MODE_PAGE_FLIP_ASYNC;
     }
 
+    // accepted is recomputed by assignLayers
+    if (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_LAYERS) {
+        for (auto const& l : STATE.layers) {
+            l->accepted = false;
+        }
+    }
+
     // we can't go further without a blit
     if (backend->primary && onlyTest)
         return true;
 
-    SDRMConnectorCommitData data;
-
     if (STATE.buffer) {
         TRACE(backend->backend->log(AQ_LOG_TRACE, "drm: Committed a buffer, updating state"));
 
         SP<CDRMFB> drmFB;
 
         if (backend->shouldBlit()) {
-            if (!backend->rendererState.renderer) {
+            if (!backend->initMgpu()) {
                 backend->backend->log(AQ_LOG_ERROR, "drm: No renderer attached to backend when required for blitting");
                 return false;
             }
@@ -1721,22 +2348,48 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
             OPTIONS.multigpu = false; // this is not a shared swapchain, and additionally, don't make it linear, nvidia would be mad
             OPTIONS.cursor   = false;
             OPTIONS.scanout  = true;
+            if (STATE.presentationMode == AQ_OUTPUT_PRESENTATION_MAILBOX)
+                OPTIONS.length = std::max(OPTIONS.length, MGPU_MAILBOX_LENGTH);
             if (!mgpu.swapchain->reconfigure(OPTIONS)) {
                 backend->backend->log(AQ_LOG_ERROR, "drm: Backend requires blit, but the mgpu swapchain failed reconfiguring");
                 return false;
             }
 
-            auto                         NEWAQBUF = mgpu.swapchain->next(nullptr);
+            int                          age      = 0;
+            auto                         NEWAQBUF = mgpu.swapchain->next(&age);
             SP<Aquamarine::CDRMRenderer> primaryRenderer;
             if (backend->primary)
                 primaryRenderer = backend->primary->rendererState.renderer;
-            auto blitResult = backend->rendererState.renderer->blit(
-                STATE.buffer, NEWAQBUF, primaryRenderer, (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE) ? STATE.explicitInFence : -1);
+
+            // the target buffer is missing this frame's damage plus whatever changed since it was last blitted to.
+            // without a full history (or damage at all), copy everything.
+            const CBox FULL        = {{}, STATE.buffer->size};
+            const auto FRAMEDAMAGE = (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_DAMAGE) ? STATE.damage.copy().intersect(FULL) : CRegion{FULL};
+            CRegion    blitDamage  = FULL;
+            if (age > 0 && (size_t)age - 1 <= mgpu.damageRing.size()) {
+                blitDamage = FRAMEDAMAGE;
+                for (int i = 0; i < age - 1; ++i) {
+                    blitDamage.add(mgpu.damageRing.at(i));
+                }
+            }
+
+            if (!mgpu.readback)
+                mgpu.readback = makeShared<CDRMReadback>();
+
+            auto blitResult = backend->rendererState.renderer->blit(STATE.buffer, NEWAQBUF, primaryRenderer,
+                                                                    (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE) ? STATE.explicitInFence : -1,
+                                                                    blitDamage, mgpu.readback);
             if (!blitResult.success) {
                 backend->backend->log(AQ_LOG_ERROR, "drm: Backend requires blit, but blit failed");
+                mgpu.damageRing.clear();
                 return false;
             }
 
+            mgpu.damageRing.push_front(FRAMEDAMAGE);
+            while (mgpu.damageRing.size() > MGPU_DAMAGE_RING) {
+                mgpu.damageRing.pop_back();
+            }
+
             // replace the explicit in fence if the blitting backend returned one, otherwise discard old. Passed fence from the client is wrong.
             // if the commit doesn't have an explicit fence, don't use the one we created, just fallback to implicit
             static auto NO_EXPLICIT = envEnabled("AQ_MGPU_NO_EXPLICIT");
@@ -1808,6 +2461,137 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
     else
         data.calculateMode(connector);
 
+    if (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_LAYERS)
+        assignLayers(data);
+
+    return true;
+}
+
+template <typename T>
+static void appendSignature(std::string& sig, const T& value) {
+    sig.append((const char*)&value, sizeof(T));
+}
+
+static void appendSignature(std::string& sig, const CBox& box) {
+    for (double v : {box.x, box.y, box.w, box.h}) {
+        appendSignature(sig, v);
+    }
+}
+
+static void appendFBSignature(std::string& sig, const SP<CDRMFB>& fb) {
+    if (!fb || !fb->buffer) {
+        appendSignature(sig, (uint8_t)0);
+        return;
+    }
+
+    const auto ATTRS = fb->buffer->dmabuf();
+    appendSignature(sig, (uint8_t)1);
+    appendSignature(sig, ATTRS.size.x);
+    appendSignature(sig, ATTRS.size.y);
+    appendSignature(sig, ATTRS.format);
+    appendSignature(sig, ATTRS.modifier);
+    appendSignature(sig, ATTRS.planes);
+    appendSignature(sig, ATTRS.offsets);
+    appendSignature(sig, ATTRS.strides);
+}
+
+std::string Aquamarine::CDRMOutput::testSignature(const SDRMConnectorCommitData& data) {
+    const auto& STATE = state->state();
+
+    // buffer contents, damage, fences and the cursor position don't change what KMS thinks of a commit
+    constexpr uint32_t IGNORED = COutputState::AQ_OUTPUT_STATE_DAMAGE | COutputState::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE |
+        COutputState::AQ_OUTPUT_STATE_EXPLICIT_OUT_FENCE | COutputState::AQ_OUTPUT_STATE_CURSOR_POS;
+
+    std::string sig;
+    sig.reserve(256);
+
+    appendSignature(sig, connector->crtc->id);
+    appendSignature(sig, STATE.committed & ~IGNORED);
+    appendSignature(sig, STATE.enabled);
+    appendSignature(sig, STATE.adaptiveSync);
+    appendSignature(sig, STATE.presentationMode);
+    appendSignature(sig, STATE.drmFormat);
+    appendSignature(sig, STATE.contentType);
+    appendSignature(sig, STATE.wideColorGamut);
+    appendSignature(sig, data.modeset);
+    appendSignature(sig, data.blocking);
+    appendSignature(sig, data.flags);
+    appendSignature(sig, connector->commitTainted);
+    appendSignature(sig, data.modeInfo);
+    appendSignature(sig, cursorVisible);
+
+    appendFBSignature(sig, data.mainFB);
+    appendFBSignature(sig, data.cursorFB);
+
+    appendSignature(sig, data.overlaysChanged);
+    for (auto const& o : data.overlays) {
+        appendSignature(sig, o.plane->id);
+        appendSignature(sig, o.layer->src);
+        appendSignature(sig, o.layer->dst);
+        appendSignature(sig, o.layer->transform);
+        appendFBSignature(sig, o.fb);
+    }
+
+    if (STATE.committed & COutputState::AQ_OUTPUT_STATE_GAMMA_LUT) {
+        appendSignature(sig, STATE.gammaLut.size());
+        sig.append((const char*)STATE.gammaLut.data(), STATE.gammaLut.size() * sizeof(uint16_t));
+    }
+
+    if (STATE.committed & COutputState::AQ_OUTPUT_STATE_DEGAMMA_LUT) {
+        appendSignature(sig, STATE.degammaLut.size());
+        sig.append((const char*)STATE.degammaLut.data(), STATE.degammaLut.size() * sizeof(uint16_t));
+    }
+
+    if (data.ctm.has_value()) {
+        for (auto v : data.ctm->getMatrix()) {
+            appendSignature(sig, v);
+        }
+    }
+
+    if (STATE.committed & COutputState::AQ_OUTPUT_STATE_HDR)
+        appendSignature(sig, STATE.hdrMetadata);
+
+    return sig;
+}
+
+void Aquamarine::CDRMOutput::invalidateTestCache() {
+    testCache.clear();
+}
+
+bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
+    SDRMConnectorCommitData data;
+
+    if (!prepareCommit(onlyTest, data, true))
+        return false;
+
+    // we can't go further without a blit
+    if (backend->primary && onlyTest)
+        return true;
+
+    // mailbox commits and buffers that came in during a cursor-only flip go out from the pf handler, taking the cursor along
+    const auto& STATE       = state->state();
+    const bool  BEHIND_FLIP = (connector->isPageFlipPending && STATE.presentationMode == AQ_OUTPUT_PRESENTATION_MAILBOX) || (connector->cursorFlipPending && !data.blocking);
+    if (!onlyTest && BEHIND_FLIP && (STATE.committed & COutputState::AQ_OUTPUT_STATE_BUFFER)) {
+        queueMailbox(data);
+        finishCommit(data);
+        return true;
+    }
+
+    std::string signature;
+    if (onlyTest) {
+        signature = testSignature(data);
+
+        if (auto it = testCache.find(signature); it != testCache.end()) {
+            testCacheStats.hits++;
+            TRACE(backend->backend->log(AQ_LOG_TRACE,
+                                        std::format("drm: test on {} answered from cache: {} ({} hits, {} misses)", name, it->second ? "ok" : "failed", testCacheStats.hits,
+                                                    testCacheStats.misses)));
+            return it->second;
+        }
+
+        testCacheStats.misses++;
+    }
+
     bool ok = connector->commitState(data);
 
     if (!ok && !data.modeset && !connector->commitTainted) {
@@ -1822,17 +2606,59 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
             connector->commitTainted = true;
     }
 
+    if (onlyTest) {
+        if (testCache.size() >= MAX_TEST_CACHE)
+            testCache.clear();
+
+        testCache.emplace(std::move(signature), ok);
+    }
+
+    if (!ok && !onlyTest) {
+        lastLayerAssignment.clear();
+        // a test said yes to this, don't trust that anymore
+        invalidateTestCache();
+    }
+
     if (onlyTest || !ok)
         return ok;
 
+    finishCommit(data);
+
+    return true;
+}
+
+void Aquamarine::CDRMOutput::finishCommit(const SDRMConnectorCommitData& data) {
     events.commit.emit();
     state->onCommit();
 
-    lastCommitNoBuffer = !data.mainFB;
-    needsFrame         = false;
+    lastCommitNoBuffer       = !data.mainFB;
+    needsFrame               = false;
+    connector->commitTainted = false;
 
-    if (ok)
-        connector->commitTainted = false;
+    if (data.mainFB && lateFrames.frameSent) {
+        const auto TOOK = monotonicNs() - lateFrames.frameSent;
+
+        // a commit long after the frame event wasn't rendering the whole time
+        if (!connector->refresh || TOOK < 1000000000000ULL / connector->refresh) {
+            lateFrames.renderTimes.at(lateFrames.renderSamples++ % lateFrames.renderTimes.size()) = TOOK;
+            lateFrames.committed                                                                = lateFrames.lateSent;
+        }
+
+        lateFrames.frameSent = 0;
+    }
+
+    // the cursor position went out with this one
+    if (data.mainFB && cursorCommit.dirty) {
+        cursorCommit.dirty = false;
+        if (cursorCommit.deadline) {
+            cursorCommit.deadline = 0;
+            backend->updateTimer();
+        }
+    }
+
+    // a modeset can change what fits for every output on the device
+    if (data.modeset)
+        backend->invalidateTestCaches();
 
     if (data.flags & DRM_MODE_PAGE_FLIP_ASYNC) {
         // for tearing commits, we will send presentation feedback instantly, and rotate
@@ -1855,8 +2681,140 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
 
         connector->onPresent();
     }
+}
 
-    return ok;
+bool Aquamarine::CDRMOutput::reuseLayerAssignment(SDRMConnectorCommitData& data) {
+    const auto& LAYERS = state->state().layers;
+
+    if (lastLayerAssignment.size() != LAYERS.size())
+        return false;
+
+    std::vector<SDRMOverlayCommit> overlays;
+
+    for (size_t i = 0; i < LAYERS.size(); ++i) {
+        const auto& L = LAYERS.at(i);
+        const auto& A = lastLayerAssignment.at(i);
+
+        if (A.layer.get() != L.get() || !L->buffer || A.src != L->src || A.dst != L->dst || A.transform != L->transform || A.size != L->buffer->size)
+            return false;
+
+        const auto ATTRS = L->buffer->dmabuf();
+        if (!ATTRS.success || ATTRS.format != A.format || ATTRS.modifier != A.modifier)
+            return false;
+
+        if (!A.plane)
+            continue;
+
+        auto plane = A.plane.lock();
+        if (plane->overlayCrtc != 0 && plane->overlayCrtc != connector->crtc->id)
+            return false;
+
+        auto fb = CDRMFB::create(L->buffer, backend, nullptr);
+        if (!fb || fb->dead)
+            return false;
+
+        overlays.emplace_back(SDRMOverlayCommit{.layer = L, .plane = plane, .fb = fb});
+    }
+
+    data.overlays = std::move(overlays);
+    for (auto const& o : data.overlays) {
+        o.layer->accepted = true;
+    }
+
+    return true;
+}
+
+void Aquamarine::CDRMOutput::assignLayers(SDRMConnectorCommitData& data) {
+    const auto& STATE = state->state();
+
+    data.overlaysChanged = true;
+    data.overlays.clear();
+
+    // legacy can't do overlays, and with mgpu every layer would need a blit anyways
+    if (!backend->atomic || backend->primary || !STATE.enabled || !data.mainFB || STATE.layers.empty() || connector->crtc->overlays.empty()) {
+        lastLayerAssignment.clear();
+        return;
+    }
+
+    if (reuseLayerAssignment(data)) {
+        TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: Reusing the last layer assignment, {} of {} layers on overlays", data.overlays.size(), STATE.layers.size())));
+        return;
+    }
+
+    std::vector<SP<SDRMPlane>> planes;
+    for (auto const& p : connector->crtc->overlays) {
+        if (p->overlayCrtc == 0 || p->overlayCrtc == connector->crtc->id)
+            planes.emplace_back(p);
+    }
+
+    // Go top to bottom: a layer we can't place has to be composited into the primary plane, which is below
+    // every overlay, so nothing below it may go on an overlay either. Planes are taken top to bottom too, to keep the order.
+    auto sorted = STATE.layers;
+    std::ranges::stable_sort(sorted, [](const auto& a, const auto& b) { return a->zpos > b->zpos; });
+
+    // a page flip event is invalid in a TEST_ONLY commit
+    auto testData  = data;
+    testData.test  = true;
+    testData.flags = data.flags & ~DRM_MODE_PAGE_FLIP_EVENT;
+
+    int nextPlane = (int)planes.size() - 1;
+    for (auto const& layer : sorted) {
+        if (nextPlane < 0 || !layer->buffer)
+            break;
+
+        const auto ATTRS = layer->buffer->dmabuf();
+        if (!ATTRS.success)
+            break;
+
+        auto fb = CDRMFB::create(layer->buffer, backend, nullptr);
+        if (!fb || fb->dead)
+            break;
+
+        bool placed = false;
+        for (int i = nextPlane; i >= 0; --i) {
+            const auto& PLANE = planes.at(i);
+            if (!PLANE->supportsFormat(ATTRS.format, ATTRS.modifier))
+                continue;
+
+            if (layer->transform != HYPRUTILS_TRANSFORM_NORMAL && !PLANE->props.values.rotation)
+                continue;
+
+            auto candidate = testData;
+            candidate.overlays.emplace_back(SDRMOverlayCommit{.layer = layer, .plane = PLANE, .fb = fb});
+            if (!connector->commitState(candidate))
+                continue;
+
+            testData.overlays = std::move(candidate.overlays);
+            nextPlane         = i - 1;
+            placed            = true;
+            break;
+        }
+
+        if (!placed)
+            break;
+    }
+
+    data.overlays = std::move(testData.overlays);
+
+    lastLayerAssignment.clear();
+    for (auto const& l : STATE.layers) {
+        auto       it    = std::ranges::find_if(data.overlays, [&l](const auto& o) { return o.layer == l; });
+        const auto ATTRS = l->buffer ? l->buffer->dmabuf() : SDMABUFAttrs{};
+
+        l->accepted = it != data.overlays.end();
+        lastLayerAssignment.emplace_back(SLayerAssignment{
+            .layer     = l,
+            .plane     = l->accepted ? it->plane : nullptr,
+            .src       = l->src,
+            .dst       = l->dst,
+            .transform = l->transform,
+            .size      = l->buffer ? l->buffer->size : Vector2D{},
+            .format    = ATTRS.format,
+            .modifier  = ATTRS.modifier,
+        });
+    }
+
+    backend->backend->log(AQ_LOG_DEBUG, std::format("drm: Assigned {} of {} layers to overlay planes on {}", data.overlays.size(), STATE.layers.size(), name));
 }
 
 SP<IBackendImplementation> Aquamarine::CDRMOutput::getBackend() {
@@ -1888,6 +2846,11 @@ bool Aquamarine::CDRMOutput::setCursor(SP<IBuffer> buffer, const Vector2D& hotsp
         if (backend->primary) {
             TRACE(backend->backend->log(AQ_LOG_TRACE, "drm: Backend requires cursor blit, blitting"));
 
+            if (!backend->initMgpu()) {
+                backend->backend->log(AQ_LOG_ERROR, "drm: No renderer attached to backend when required for cursor blitting");
+                return false;
+            }
+
             // TODO: will this not implode on drm_dumb?!
 
             if (!mgpu.cursorSwapchain) {
@@ -1957,7 +2920,11 @@ void Aquamarine::CDRMOutput::scheduleFrame(const scheduleFrameReason reason) {
                                             connector->isPageFlipPending, connector->frameEventScheduled)));
     needsFrame = true;
 
-    if (connector->isPageFlipPending || connector->frameEventScheduled || !enabledState)
+    // mailbox commits can come in while a flip is pending, so can frames. Otherwise a commit queued behind a
+    // cursor-only flip counts as one.
+    const bool FLIP_BLOCKS = (connector->isPageFlipPending || mailbox.data) && state->state().presentationMode != AQ_OUTPUT_PRESENTATION_MAILBOX;
+
+    if (FLIP_BLOCKS || connector->frameEventScheduled || !enabledState)
         return;
 
     connector->frameEventScheduled = true;
@@ -2017,10 +2984,232 @@ Aquamarine::CDRMOutput::CDRMOutput(const std::string& name_, Hyprutils::Memory::
 
     frameIdle = makeShared<std::function<void(void)>>([this]() {
         connector->frameEventScheduled = false;
-        if (connector->isPageFlipPending)
+        if ((connector->isPageFlipPending || mailbox.data) && state->state().presentationMode != AQ_OUTPUT_PRESENTATION_MAILBOX)
             return;
-        events.frame.emit();
+        sendFrame();
     });
+
+    static const auto LATE_FRAMES = envEnabled("AQ_DRM_LATE_FRAMES");
+    setLateFrames(LATE_FRAMES);
+}
+
+void Aquamarine::CDRMOutput::setLateFrames(bool enabled) {
+    lateFrames.enabled = enabled;
+    lateFrames.margin  = LATE_FRAME_MARGIN_MIN;
+
+    if (enabled || !lateFrames.deadline)
+        return;
+
+    // a frame is being held back, let it go
+    lateFrames.deadline            = 0;
+    connector->frameEventScheduled = false;
+    backend->updateTimer();
+    scheduleFrame(AQ_SCHEDULE_UNKNOWN);
+}
+
+void Aquamarine::CDRMOutput::sendFrame(bool late) {
+    lateFrames.frameSent = monotonicNs();
+    lateFrames.lateSent  = late;
+    events.frame.emit();
+}
+
+bool Aquamarine::CDRMOutput::scheduleLateFrame(uint64_t flipNs) {
+    const auto& STATE = state->state();
+
+    // vrr and tearing have no vblank to aim for
+    if (!lateFrames.enabled || !connector->refresh || STATE.adaptiveSync || STATE.presentationMode != AQ_OUTPUT_PRESENTATION_VSYNC)
+        return false;
+
+    const uint64_t PERIOD = 1000000000000ULL / connector->refresh;
+
+    // did the last late frame make its vblank?
+    if (lateFrames.committed) {
+        if (flipNs > lateFrames.targetVblank + PERIOD / 2) {
+            lateFrames.margin = std::min(lateFrames.margin + LATE_FRAME_MARGIN_STEP, PERIOD / 2);
+            TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: late frame on {} missed its vblank, margin now {}us", name, lateFrames.margin / 1000)));
+        } else
+            lateFrames.margin = std::max(lateFrames.margin - std::min(lateFrames.margin, LATE_FRAME_MARGIN_DECAY), LATE_FRAME_MARGIN_MIN);
+    }
+
+    lateFrames.committed    = false;
+    lateFrames.targetVblank = flipNs + PERIOD;
+
+    // no guessing before we've seen a few frames
+    if (lateFrames.renderSamples < lateFrames.renderTimes.size() / 2)
+        return false;
+
+    const uint64_t BUDGET = *std::ranges::max_element(lateFrames.renderTimes) + lateFrames.margin;
+    if (BUDGET >= lateFrames.targetVblank || lateFrames.targetVblank - BUDGET <= monotonicNs())
+        return false;
+
+    lateFrames.deadline            = lateFrames.targetVblank - BUDGET;
+    connector->frameEventScheduled = true;
+    backend->updateTimer();
+
+    return true;
+}
+
+bool Aquamarine::CDRMOutput::canCommitCursor() {
+    return backend->atomic && backend->sessionActive() && enabledState && !lastCommitNoBuffer && cursorVisible && connector->crtc && connector->crtc->cursor &&
+        connector->crtc->cursor->front && !connector->crtc->pendingCursor && !(state->state().committed & COutputState::AQ_OUTPUT_STATE_CURSOR_SHAPE);
+}
+
+bool Aquamarine::CDRMOutput::awaitingFrame(uint64_t now) {
+    if (connector->frameEventScheduled)
+        return true;
+
+    // a frame event is out and the compositor might be about to commit. Its commit would wait for a cursor-only
+    // one in flight, so give it a refresh before assuming it has nothing to draw.
+    return connector->refresh && lateFrames.frameSent && now < lateFrames.frameSent + 1000000000000ULL / connector->refresh;
+}
+
+void Aquamarine::CDRMOutput::scheduleCursorCommit() {
+    if (cursorCommit.deadline)
+        return;
+
+    // a flip in flight, the pf handler calls back
+    if (connector->isPageFlipPending || connector->cursorFlipPending)
+        return;
+
+    if (!canCommitCursor()) {
+        cursorCommit.dirty = false;
+        scheduleFrame(AQ_SCHEDULE_CURSOR_MOVE);
+        return;
+    }
+
+    const auto& STATE = state->state();
+    const auto  NOW   = monotonicNs();
+    uint64_t    when  = NOW;
+
+    // aim just before the next vblank, so that every move until then makes it in. Vrr has no vblank to aim for.
+    if (connector->refresh && cursorCommit.lastVblank && cursorCommit.lastVblank <= NOW && !STATE.adaptiveSync) {
+        const uint64_t PERIOD = 1000000000000ULL / connector->refresh;
+        const uint64_t VBLANK = cursorCommit.lastVblank + PERIOD * ((NOW - cursorCommit.lastVblank) / PERIOD + 1);
+
+        if (VBLANK > NOW + CURSOR_LATCH_MARGIN)
+            when = VBLANK - CURSOR_LATCH_MARGIN;
+
+        if (awaitingFrame(NOW))
+            when = std::max(when, VBLANK + PERIOD - CURSOR_LATCH_MARGIN);
+    } else if (awaitingFrame(NOW))
+        return; // merged into that frame, or back here from the next flip
+
+    if (when <= NOW) {
+        commitCursor();
+        return;
+    }
+
+    cursorCommit.deadline = when;
+    backend->updateTimer();
+}
+
+void Aquamarine::CDRMOutput::commitCursor() {
+    cursorCommit.deadline = 0;
+
+    // a queued commit takes the cursor along when it goes out
+    if (!cursorCommit.dirty || connector->isPageFlipPending || connector->cursorFlipPending || mailbox.data)
+        return;
+
+    // let the commit answering the frame take the cursor along
+    if (awaitingFrame(monotonicNs())) {
+        scheduleCursorCommit();
+        return;
+    }
+
+    if (!canCommitCursor() || !((CDRMAtomicImpl*)backend->impl.get())->commitCursor(connector)) {
+        cursorCommit.dirty = false;
+        scheduleFrame(AQ_SCHEDULE_CURSOR_MOVE);
+        return;
+    }
+
+    TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: cursor-only commit on {} at {}, {}", name, cursorPos.x, cursorPos.y)));
+
+    cursorCommit.dirty = false;
+    state->internalState.committed &= ~COutputState::AQ_OUTPUT_STATE_CURSOR_POS;
+}
+
+void Aquamarine::CDRMOutput::queueMailbox(const SDRMConnectorCommitData& data) {
+    if (mailbox.data) {
+        TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: mailbox commit on {} replaced before its flip", name)));
+        discardMailbox();
+    }
+
+    mailbox.data  = makeShared<SDRMConnectorCommitData>(data);
+    mailbox.state = state->internalState;
+
+    // don't let swapchains hand these out again while they wait. These are the buffers KMS will scan out,
+    // with mgpu that's our blit target rather than the compositor's buffer.
+    auto lock = [this](SP<CDRMFB> fb) {
+        if (!fb || !fb->buffer || fb->buffer->lockedByBackend)
+            return;
+
+        fb->buffer->lockedByBackend = true;
+        mailbox.locked.emplace_back(fb->buffer.lock());
+    };
+
+    lock(data.mainFB);
+    for (auto const& o : data.overlays) {
+        lock(o.fb);
+    }
+
+    // the fence has to outlive the commit call, and there is no out fence before the commit goes out
+    if (mailbox.state.explicitInFence >= 0)
+        mailbox.state.explicitInFence = fcntl(mailbox.state.explicitInFence, F_DUPFD_CLOEXEC, 0);
+    mailbox.state.committed &= ~COutputState::AQ_OUTPUT_STATE_EXPLICIT_OUT_FENCE;
+}
+
+void Aquamarine::CDRMOutput::submitMailbox() {
+    if (!mailbox.data)
+        return;
+
+    if (!backend->sessionActive() || !enabledState) {
+        discardMailbox();
+        return;
+    }
+
+    // applyCommit locks what KMS ends up scanning out
+    for (auto const& buffer : mailbox.locked) {
+        buffer->lockedByBackend = false;
+    }
+
+    // the commit sees the state it was made with, whatever is being staged for the next one is put back after
+    std::swap(state->internalState, mailbox.state);
+    const bool OK = connector->commitState(*mailbox.data);
+    std::swap(state->internalState, mailbox.state);
+
+    if (!OK) {
+        backend->backend->log(AQ_LOG_ERROR, std::format("drm: mailbox commit on {} failed, dropping it", name));
+        discardMailbox();
+        scheduleFrame(AQ_SCHEDULE_NEEDS_FRAME);
+        return;
+    }
+
+    if (mailbox.state.explicitInFence >= 0)
+        close(mailbox.state.explicitInFence);
+
+    mailbox.data.reset();
+    mailbox.state = {};
+    mailbox.locked.clear();
+}
+
+void Aquamarine::CDRMOutput::discardMailbox() {
+    if (!mailbox.data)
+        return;
+
+    // KMS never saw these. Buffers that are on screen from an earlier commit weren't locked here and stay.
+    for (auto const& buffer : mailbox.locked) {
+        buffer->lockedByBackend = false;
+        buffer->events.backendRelease.emit();
+    }
+
+    if (mailbox.state.explicitInFence >= 0)
+        close(mailbox.state.explicitInFence);
+
+    mailbox.data.reset();
+    mailbox.state = {};
+    mailbox.locked.clear();
+
+    events.present.emit(SPresentEvent{.presented = false});
 }
 
 SP<CDRMFB> Aquamarine::CDRMFB::create(SP<IBuffer> buffer_, Hyprutils::Memory::CWeakPointer<CDRMBackend> backend_, bool* isNew) {
@@ -2067,28 +3256,38 @@ void Aquamarine::CDRMFB::import() {
         return;
     }
 
-    // TODO: check format
-    for (int i = 0; i < attrs.planes; ++i) {
-        int ret = drmPrimeFDToHandle(backend->gpu->fd, attrs.fds.at(i), &boHandles[i]);
-        if (ret) {
-            backend->backend->log(AQ_LOG_ERROR, "drm: drmPrimeFDToHandle failed");
-            drop();
+    const auto KEY = CDRMFBCache::keyFor(attrs);
+    if (KEY.has_value()) {
+        if (backend->fbCache->isUnimportable(*KEY)) {
+            backend->backend->log(AQ_LOG_ERROR, "drm: Buffer submitted is unimportable (seen before)");
+            buffer->attachments.add(makeShared<CDRMBufferUnimportable>());
             return;
         }
 
-        TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: CDRMFB: plane {} has fd {}, got handle {}", i, attrs.fds.at(i), boHandles.at(i))));
+        // another wrapper of the same dmabuf is already in KMS
+        id = backend->fbCache->acquire(*KEY);
     }
 
-    id = submitBuffer();
-
     if (!id) {
-        backend->backend->log(AQ_LOG_ERROR, "drm: Failed to submit a buffer to KMS");
-        buffer->attachments.add(makeShared<CDRMBufferUnimportable>());
-        drop();
-        return;
-    }
+        if (!importHandles(attrs))
+            return;
+
+        id = submitBuffer();
+
+        if (!id) {
+            backend->backend->log(AQ_LOG_ERROR, "drm: Failed to submit a buffer to KMS");
+            buffer->attachments.add(makeShared<CDRMBufferUnimportable>());
+            if (KEY.has_value())
+                backend->fbCache->markUnimportable(*KEY);
+            drop();
+            return;
+        }
+
+        TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: new buffer {}", id)));
 
-    TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: new buffer {}", id)));
+        if (KEY.has_value())
+            backend->fbCache->add(*KEY, id);
+    }
 
     closeHandles();
 
@@ -2100,6 +3299,22 @@ void Aquamarine::CDRMFB::import() {
     });
 }
 
+bool Aquamarine::CDRMFB::importHandles(const SDMABUFAttrs& attrs) {
+    // TODO: check format
+    for (int i = 0; i < attrs.planes; ++i) {
+        int ret = drmPrimeFDToHandle(backend->gpu->fd, attrs.fds.at(i), &boHandles[i]);
+        if (ret) {
+            backend->backend->log(AQ_LOG_ERROR, "drm: drmPrimeFDToHandle failed");
+            drop();
+            return false;
+        }
+
+        TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: CDRMFB: plane {} has fd {}, got handle {}", i, attrs.fds.at(i), boHandles.at(i))));
+    }
+
+    return true;
+}
+
 void Aquamarine::CDRMFB::reimport() {
     drop();
     dropped       = false;
@@ -2153,6 +3368,12 @@ void Aquamarine::CDRMFB::drop() {
 
     closeHandles();
 
+    // other wrappers of the same dmabuf may still scan it out
+    if (!backend->fbCache->unref(id)) {
+        TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: buffer {} still in use, not closing", id)));
+        return;
+    }
+
     TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: dropping buffer {}", id)));
 
     int ret = drmModeCloseFB(backend->gpu->fd, id);
@@ -0,0 +1,123 @@
+#include "FBCache.hpp"
+#include "Shared.hpp"
+#include <format>
+#include <sys/stat.h>
+
+using namespace Aquamarine;
+using namespace Hyprutils::Memory;
+#define SP CSharedPointer
+
+// verdicts are a few bytes each, but clients cycling through broken buffers shouldn't grow this forever
+constexpr size_t MAX_UNIMPORTABLE = 64;
+
+static void hashCombine(size_t& seed, uint64_t v) {
+    seed ^= std::hash<uint64_t>{}(v) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+size_t Aquamarine::CDRMFBCache::SKeyHash::operator()(const SKey& key) const {
+    size_t seed = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        hashCombine(seed, key.inodes[i]);
+        hashCombine(seed, ((uint64_t)key.offsets[i] << 32) | key.strides[i]);
+    }
+    hashCombine(seed, ((uint64_t)key.size.x << 32) | (uint64_t)key.size.y);
+    hashCombine(seed, key.format);
+    hashCombine(seed, key.modifier);
+    return seed;
+}
+
+Aquamarine::CDRMFBCache::CDRMFBCache(CWeakPointer<CDRMBackend> backend_) : backend(backend_) {
+    ;
+}
+
+std::optional<CDRMFBCache::SKey> Aquamarine::CDRMFBCache::keyFor(const SDMABUFAttrs& attrs) {
+    SKey key = {
+        .offsets  = attrs.offsets,
+        .strides  = attrs.strides,
+        .size     = attrs.size,
+        .format   = attrs.format,
+        .modifier = attrs.modifier,
+    };
+
+    // dmabuf inode numbers come from a counter, they aren't reused while the system is up
+    for (int i = 0; i < attrs.planes && i < 4; ++i) {
+        struct stat st;
+        if (attrs.fds.at(i) < 0 || fstat(attrs.fds.at(i), &st))
+            return std::nullopt;
+
+        key.inodes[i] = st.st_ino;
+    }
+
+    return key;
+}
+
+uint32_t Aquamarine::CDRMFBCache::acquire(const SKey& key) {
+    auto it = byKey.find(key);
+    if (it == byKey.end()) {
+        stats.misses++;
+        return 0;
+    }
+
+    stats.hits++;
+    TRACE(backend->log(AQ_LOG_TRACE, std::format("drm: fb cache hit, fb {} ({} hits, {} misses)", it->second, stats.hits, stats.misses)));
+
+    ref(it->second);
+    return it->second;
+}
+
+void Aquamarine::CDRMFBCache::add(const SKey& key, uint32_t id) {
+    fbs[id] = SFB{.refs = 1, .key = key};
+    byKey[key] = id;
+}
+
+void Aquamarine::CDRMFBCache::ref(uint32_t id) {
+    auto it = fbs.find(id);
+    if (it == fbs.end())
+        return;
+
+    it->second.refs++;
+}
+
+bool Aquamarine::CDRMFBCache::unref(uint32_t id) {
+    auto it = fbs.find(id);
+    if (it == fbs.end())
+        return true;
+
+    if (--it->second.refs > 0)
+        return false;
+
+    if (it->second.key.has_value())
+        byKey.erase(*it->second.key);
+
+    fbs.erase(it);
+    return true;
+}
+
+void Aquamarine::CDRMFBCache::markUnimportable(const SKey& key) {
+    if (!unimportable.emplace(key).second)
+        return;
+
+    unimportableOrder.emplace_back(key);
+
+    while (unimportableOrder.size() > MAX_UNIMPORTABLE) {
+        unimportable.erase(unimportableOrder.front());
+        unimportableOrder.pop_front();
+    }
+}
+
+bool Aquamarine::CDRMFBCache::isUnimportable(const SKey& key) {
+    return unimportable.contains(key);
+}
+
+void Aquamarine::CDRMFBCache::clear() {
+    if (!byKey.empty() && backend)
+        backend->log(AQ_LOG_DEBUG, std::format("drm: fb cache: forgetting {} fbs and {} unimportable buffers", byKey.size(), unimportable.size()));
+
+    for (auto& [id, fb] : fbs) {
+        fb.key.reset();
+    }
+
+    byKey.clear();
+    unimportable.clear();
+    unimportableOrder.clear();
+}
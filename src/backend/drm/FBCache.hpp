@@ -0,0 +1,70 @@
+#pragma once
+
+#include <aquamarine/backend/DRM.hpp>
+#include <array>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Aquamarine {
+
+    /*
+        IBuffers are wrappers, the same dmabuf can come in through several of them. KMS fbs are looked
+        up by what's behind the fds instead: the dmabuf inodes, plus the layout. Every CDRMFB using an
+        fb id holds a ref on it here, the last one to drop it closes it.
+        Buffers KMS refused are remembered too, so new wrappers don't have to find out again.
+    */
+    class CDRMFBCache {
+      public:
+        CDRMFBCache(Hyprutils::Memory::CWeakPointer<CDRMBackend> backend_);
+
+        struct SKey {
+            std::array<uint64_t, 4>   inodes  = {0};
+            std::array<uint32_t, 4>   offsets = {0};
+            std::array<uint32_t, 4>   strides = {0};
+            Hyprutils::Math::Vector2D size;
+            uint32_t                  format   = 0;
+            uint64_t                  modifier = 0;
+
+            bool                      operator==(const SKey& other) const = default;
+        };
+
+        // nullopt if the fds can't be stat'd
+        static std::optional<SKey> keyFor(const SDMABUFAttrs& attrs);
+
+        // a referenced fb id for the key, 0 if there is none
+        uint32_t acquire(const SKey& key);
+        // registers a new fb, with one ref
+        void     add(const SKey& key, uint32_t id);
+        void     ref(uint32_t id);
+        // true if this was the last ref (or the id is unknown) and the caller should close the fb
+        bool     unref(uint32_t id);
+
+        void     markUnimportable(const SKey& key);
+        bool     isUnimportable(const SKey& key);
+
+        // forgets all lookups and verdicts. Fbs in use stay refcounted.
+        void clear();
+
+      private:
+        struct SKeyHash {
+            size_t operator()(const SKey& key) const;
+        };
+
+        struct SFB {
+            size_t              refs = 0;
+            std::optional<SKey> key;
+        };
+
+        Hyprutils::Memory::CWeakPointer<CDRMBackend>   backend;
+        std::unordered_map<uint32_t, SFB>              fbs;   // by fb id
+        std::unordered_map<SKey, uint32_t, SKeyHash>   byKey; // dmabuf -> fb id
+        std::unordered_set<SKey, SKeyHash>             unimportable;
+        std::deque<SKey>                               unimportableOrder; // oldest first
+
+        struct {
+            uint64_t hits = 0, misses = 0;
+        } stats;
+    };
+};
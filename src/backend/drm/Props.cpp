@@ -73,6 +73,7 @@ static const struct prop_info plane_info[] = {
     {.name = "SRC_Y", .index = INDEX(src_y)},
     {.name = "rotation", .index = INDEX(rotation)},
     {.name = "type", .index = INDEX(type)},
+    {.name = "zpos", .index = INDEX(zpos)},
 #undef INDEX
 };
 
@@ -223,4 +224,15 @@ namespace Aquamarine {
         return true;
     }
 
+    bool isDRMPropImmutable(int fd, uint32_t prop_id) {
+        drmModePropertyRes* prop = drmModeGetProperty(fd, prop_id);
+        if (!prop)
+            return true;
+
+        const bool immutable = prop->flags & DRM_MODE_PROP_IMMUTABLE;
+
+        drmModeFreeProperty(prop);
+        return immutable;
+    }
+
 };
@@ -11,4 +11,5 @@ namespace Aquamarine {
     void* getDRMPropBlob(int fd, uint32_t obj, uint32_t prop, size_t* ret_len);
     char* getDRMPropEnum(int fd, uint32_t obj, uint32_t prop_id);
     bool  introspectDRMPropRange(int fd, uint32_t prop_id, uint64_t* min, uint64_t* max);
+    bool  isDRMPropImmutable(int fd, uint32_t prop_id);
 };
@@ -761,9 +761,8 @@ CGLTex CDRMRenderer::glTex(Hyprutils::Memory::CSharedPointer<IBuffer> buffa) {
 
 constexpr GLenum PIXEL_BUFFER_FORMAT = GL_RGBA;
 
-void             CDRMRenderer::readBuffer(Hyprutils::Memory::CSharedPointer<IBuffer> buf, std::span<uint8_t> out) {
-    CEglContextGuard eglContext(*this);
-    auto             att = buf->attachments.get<CDRMRendererBufferAttachment>();
+GLuint           CDRMRenderer::readFBO(Hyprutils::Memory::CSharedPointer<IBuffer> buf) {
+    auto att = buf->attachments.get<CDRMRendererBufferAttachment>();
     if (!att) {
         att = makeShared<CDRMRendererBufferAttachment>(self, buf, nullptr, 0, 0, CGLTex{}, std::vector<uint8_t>());
         buf->attachments.add(att);
@@ -774,7 +773,8 @@ void             CDRMRenderer::readBuffer(Hyprutils::Memory::CSharedPointer<IBuf
         att->eglImage = createEGLImage(dma);
         if (att->eglImage == EGL_NO_IMAGE_KHR) {
             backend->log(AQ_LOG_ERROR, std::format("EGL (readBuffer): createEGLImage failed: {}", eglGetError()));
-            return;
+            att->eglImage = nullptr;
+            return 0;
         }
 
         GLCALL(glGenRenderbuffers(1, &att->rbo));
@@ -788,16 +788,107 @@ void             CDRMRenderer::readBuffer(Hyprutils::Memory::CSharedPointer<IBuf
 
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
             backend->log(AQ_LOG_ERROR, std::format("EGL (readBuffer): glCheckFramebufferStatus failed: {}", glGetError()));
-            return;
+            return 0;
         }
     }
 
-    GLCALL(glBindFramebuffer(GL_FRAMEBUFFER, att->fbo));
+    return att->fbo;
+}
+
+void CDRMRenderer::readBuffer(Hyprutils::Memory::CSharedPointer<IBuffer> buf, std::span<uint8_t> out) {
+    CEglContextGuard eglContext(*this);
+
+    const auto       FBO = readFBO(buf);
+    if (!FBO)
+        return;
+
+    const auto& dma = buf->dmabuf();
+    GLCALL(glBindFramebuffer(GL_FRAMEBUFFER, FBO));
     GLCALL(proc.glReadnPixelsEXT(0, 0, dma.size.x, dma.size.y, GL_RGBA, GL_UNSIGNED_BYTE, out.size(), out.data()));
 
     GLCALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
 }
 
+bool CDRMRenderer::readBufferAsync(Hyprutils::Memory::CSharedPointer<IBuffer> buf, Hyprutils::Memory::CSharedPointer<CDRMReadback> readback) {
+    CEglContextGuard eglContext(*this);
+
+    const auto       FBO = readFBO(buf);
+    if (!FBO)
+        return false;
+
+    const auto& dma    = buf->dmabuf();
+    const auto  STRIDE = (size_t)dma.size.x * 4;
+
+    readback->reader = self;
+
+    if (readback->fence) {
+        glDeleteSync(readback->fence);
+        readback->fence = nullptr;
+    }
+
+    if (!readback->pbo)
+        GLCALL(glGenBuffers(1, &readback->pbo));
+
+    GLCALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo));
+
+    if (readback->pboSize != STRIDE * dma.size.y) {
+        readback->pboSize = STRIDE * dma.size.y;
+        GLCALL(glBufferData(GL_PIXEL_PACK_BUFFER, readback->pboSize, nullptr, GL_STREAM_READ));
+    }
+
+    GLCALL(glBindFramebuffer(GL_FRAMEBUFFER, FBO));
+
+    // with a pack buffer bound, the pointer is an offset into it. Returns right away.
+    for (auto const& [y1, y2] : readback->rows) {
+        GLCALL(glReadPixels(0, y1, dma.size.x, y2 - y1, GL_RGBA, GL_UNSIGNED_BYTE, (void*)(y1 * STRIDE)));
+    }
+
+    readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    GLCALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    GLCALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+
+    return readback->fence;
+}
+
+bool CDRMRenderer::mapReadback(Hyprutils::Memory::CSharedPointer<CDRMReadback> readback, const std::function<void(const uint8_t*)>& fn) {
+    CEglContextGuard eglContext(*this);
+
+    if (!readback->fence || readback->rows.empty())
+        return false;
+
+    // a frame's worth of time is plenty, if the gpu hangs don't hang with it
+    constexpr GLuint64 TIMEOUT_NS = 100000000;
+    const auto         RESULT     = glClientWaitSync(readback->fence, GL_SYNC_FLUSH_COMMANDS_BIT, TIMEOUT_NS);
+    glDeleteSync(readback->fence);
+    readback->fence = nullptr;
+
+    if (RESULT != GL_ALREADY_SIGNALED && RESULT != GL_CONDITION_SATISFIED) {
+        backend->log(AQ_LOG_ERROR, std::format("EGL (mapReadback): readback fence didn't signal: 0x{:x}", RESULT));
+        return false;
+    }
+
+    const auto STRIDE = (size_t)readback->size.x * 4;
+    const auto FIRST  = readback->rows.front().first;
+    const auto LAST   = readback->rows.back().second;
+
+    GLCALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo));
+    auto data = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, FIRST * STRIDE, (LAST - FIRST) * STRIDE, GL_MAP_READ_BIT);
+    if (!data) {
+        backend->log(AQ_LOG_ERROR, std::format("EGL (mapReadback): glMapBufferRange failed: 0x{:x}", glGetError()));
+        GLCALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+        return false;
+    }
+
+    fn(data);
+
+    GLCALL(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+    GLCALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+    return true;
+}
+
 void CDRMRenderer::waitOnSync(int fd) {
     TRACE(backend->log(AQ_LOG_TRACE, std::format("EGL (waitOnSync): attempting to wait on fd {}", fd)));
 
@@ -916,7 +1007,8 @@ void CDRMRenderer::clearBuffer(IBuffer* buf) {
     proc.eglDestroyImageKHR(egl.display, rboImage);
 }
 
-CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, SP<CDRMRenderer> primaryRenderer, int waitFD) {
+CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, SP<CDRMRenderer> primaryRenderer, int waitFD, const std::optional<CRegion>& damage,
+                                             SP<CDRMReadback> readback) {
     CEglContextGuard eglContext(*this);
 
     if (from->dmabuf().size != to->dmabuf().size) {
@@ -937,33 +1029,78 @@ CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, S
     WP<CGLTex>         fromTex;
     const auto&        fromDma = from->dmabuf();
     std::span<uint8_t> intermediateBuf;
+    bool               asyncReadback = false;
     {
-        auto attachment = from->attachments.get<CDRMRendererBufferAttachment>();
+        auto attachment    = from->attachments.get<CDRMRendererBufferAttachment>();
+        bool needsReadback = false;
         if (attachment) {
             TRACE(backend->log(AQ_LOG_TRACE, "EGL (blit): From attachment found"));
-            fromTex         = attachment->tex;
-            intermediateBuf = attachment->intermediateBuf;
+            fromTex       = attachment->tex;
+            needsReadback = attachment->needsReadback;
         }
 
-        if ((!fromTex || !fromTex->image) && intermediateBuf.empty()) {
+        if ((!fromTex || !fromTex->image) && !needsReadback) {
             backend->log(AQ_LOG_DEBUG, "EGL (blit): No attachment in from, creating a new image");
 
             attachment = makeShared<CDRMRendererBufferAttachment>(self, from, nullptr, 0, 0, glTex(from), std::vector<uint8_t>());
             from->attachments.add(attachment);
 
             if (!attachment->tex->image && primaryRenderer) {
-                backend->log(AQ_LOG_DEBUG, "EGL (blit): Failed to create image from source buffer directly, allocating intermediate buffer");
-                static_assert(PIXEL_BUFFER_FORMAT == GL_RGBA); // If the pixel buffer format changes, the below size calculation probably needs to as well.
-                attachment->intermediateBuf.resize(fromDma.size.x * fromDma.size.y * 4);
-                intermediateBuf         = attachment->intermediateBuf;
-                attachment->tex->target = GL_TEXTURE_2D;
-                GLCALL(glGenTextures(1, &attachment->tex->texid));
+                backend->log(AQ_LOG_DEBUG, "EGL (blit): Failed to create image from source buffer directly, reading it back through the primary renderer");
+                attachment->needsReadback = needsReadback = true;
+                attachment->tex->target                   = GL_TEXTURE_2D;
             }
 
             fromTex = attachment->tex;
         }
 
-        if (!intermediateBuf.empty() && primaryRenderer) {
+        if (needsReadback && primaryRenderer && readback) {
+            // rows only, a pack buffer can't skip columns
+            if (!readback->texValid || readback->size != fromDma.size || !damage.has_value())
+                readback->rows = {{0, (int)fromDma.size.y}};
+            else {
+                readback->rows.clear();
+                for (auto const& r : damage->copy().intersect(CBox{{}, fromDma.size}).getRects()) {
+                    readback->rows.emplace_back(r.y1, r.y2);
+                }
+
+                std::ranges::sort(readback->rows);
+                for (size_t i = 1; i < readback->rows.size(); ++i) {
+                    auto& prev = readback->rows.at(i - 1);
+                    if (readback->rows.at(i).first > prev.second)
+                        continue;
+
+                    prev.second = std::max(prev.second, readback->rows.at(i).second);
+                    readback->rows.erase(readback->rows.begin() + i--);
+                }
+            }
+
+            readback->size = fromDma.size;
+
+            // Note: this might modify from's attachments
+            if (!readback->rows.empty() && !primaryRenderer->readBufferAsync(from, readback)) {
+                backend->log(AQ_LOG_ERROR, "EGL (blit): async readback failed");
+                readback->texValid = false;
+                return {};
+            }
+
+            if (!readback->tex) {
+                readback->tex         = makeUnique<CGLTex>();
+                readback->tex->target = GL_TEXTURE_2D;
+                GLCALL(glGenTextures(1, &readback->tex->texid));
+            }
+
+            readback->uploader = self;
+            fromTex            = readback->tex;
+            asyncReadback      = true;
+        } else if (needsReadback && primaryRenderer) {
+            if (!attachment->tex->texid)
+                GLCALL(glGenTextures(1, &attachment->tex->texid));
+
+            static_assert(PIXEL_BUFFER_FORMAT == GL_RGBA); // If the pixel buffer format changes, the below size calculation probably needs to as well.
+            attachment->intermediateBuf.resize(fromDma.size.x * fromDma.size.y * 4);
+            intermediateBuf = attachment->intermediateBuf;
+
             // Note: this might modify from's attachments
             primaryRenderer->readBuffer(from, intermediateBuf);
         }
@@ -1028,8 +1165,7 @@ CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, S
 
     TRACE(backend->log(AQ_LOG_TRACE, std::format("EGL (blit): fbo {} rbo {}", fboID, rboID)));
 
-    glClearColor(0.77F, 0.F, 0.74F, 1.F);
-    glClear(GL_COLOR_BUFFER_BIT);
+    // no clear, the quad covers all of it, and outside the damage we keep what the buffer had
 
     // done, let's render the texture to the rbo
     CBox renderBox = {{}, toDma.size};
@@ -1069,6 +1205,32 @@ CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, S
     if (!intermediateBuf.empty())
         GLCALL(glTexImage2D(fromTex->target, 0, PIXEL_BUFFER_FORMAT, fromDma.size.x, fromDma.size.y, 0, PIXEL_BUFFER_FORMAT, GL_UNSIGNED_BYTE, intermediateBuf.data()));
 
+    if (asyncReadback) {
+        // the readback had the time we spent setting up the destination, now we need its rows
+        if (!readback->texValid)
+            GLCALL(glTexImage2D(fromTex->target, 0, PIXEL_BUFFER_FORMAT, fromDma.size.x, fromDma.size.y, 0, PIXEL_BUFFER_FORMAT, GL_UNSIGNED_BYTE, nullptr));
+
+        const auto STRIDE   = (size_t)fromDma.size.x * 4;
+        const bool UPLOADED = readback->rows.empty() || primaryRenderer->mapReadback(readback, [&](const uint8_t* data) {
+            CEglContextGuard uploadContext(*this);
+            const auto       FIRST = readback->rows.front().first;
+            for (auto const& [y1, y2] : readback->rows) {
+                GLCALL(glTexSubImage2D(fromTex->target, 0, 0, y1, fromDma.size.x, y2 - y1, PIXEL_BUFFER_FORMAT, GL_UNSIGNED_BYTE, data + (y1 - FIRST) * STRIDE));
+            }
+        });
+
+        TRACE(backend->log(AQ_LOG_TRACE, std::format("EGL (blit): uploaded {} row spans from the readback", readback->rows.size())));
+
+        if (!UPLOADED) {
+            backend->log(AQ_LOG_ERROR, "EGL (blit): failed to map the readback");
+            readback->texValid = false;
+            GLCALL(fromTex->unbind());
+            return {};
+        }
+
+        readback->texValid = true;
+    }
+
     useProgram(SHADER.program);
     GLCALL(glDisable(GL_BLEND));
     GLCALL(glDisable(GL_SCISSOR_TEST));
@@ -1079,7 +1241,21 @@ CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, S
     GLCALL(glUniform1i(SHADER.tex, 0));
     GLCALL(glBindVertexArray(SHADER.shaderVao));
 
-    GLCALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+    if (!damage.has_value()) {
+        GLCALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+    } else {
+        // the copy maps rows 1:1 in memory, and so do damage and fbo coordinates, so no flipping here
+        const auto RECTS = damage->copy().intersect(CBox{{}, toDma.size}).getRects();
+
+        TRACE(backend->log(AQ_LOG_TRACE, std::format("EGL (blit): copying {} damaged rects", RECTS.size())));
+
+        GLCALL(glEnable(GL_SCISSOR_TEST));
+        for (auto const& r : RECTS) {
+            GLCALL(glScissor(r.x1, r.y1, r.x2 - r.x1, r.y2 - r.y1));
+            GLCALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+        }
+        GLCALL(glDisable(GL_SCISSOR_TEST));
+    }
 
     GLCALL(glBindVertexArray(0));
     GLCALL(fromTex->unbind());
@@ -1168,6 +1344,21 @@ void CGLTex::setTexParameter(GLenum pname, GLint param) {
     glTexParameteri(target, pname, param);
 }
 
+CDRMReadback::~CDRMReadback() {
+    if (reader && (pbo || fence)) {
+        CEglContextGuard eglContext(*reader);
+        if (fence)
+            glDeleteSync(fence);
+        if (pbo)
+            glDeleteBuffers(1, &pbo);
+    }
+
+    if (uploader && tex && tex->texid) {
+        CEglContextGuard eglContext(*uploader);
+        glDeleteTextures(1, &tex->texid);
+    }
+}
+
 CDRMRendererBufferAttachment::CDRMRendererBufferAttachment(Hyprutils::Memory::CWeakPointer<CDRMRenderer> renderer_, Hyprutils::Memory::CSharedPointer<IBuffer> buffer,
                                                            EGLImageKHR image, GLuint fbo_, GLuint rbo_, CGLTex&& tex_, std::vector<uint8_t> intermediateBuf_) :
     eglImage(image), fbo(fbo_), rbo(rbo_), tex(makeUnique<CGLTex>(std::move(tex_))), intermediateBuf(intermediateBuf_), renderer(renderer_) {
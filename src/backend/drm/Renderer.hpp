@@ -9,6 +9,7 @@
 #define __gl2_h_ // define guard for gl2ext.h
 #include <GLES2/gl2ext.h>
 #include <gbm.h>
+#include <functional>
 #include <optional>
 #include <tuple>
 #include <vector>
@@ -54,10 +55,32 @@ namespace Aquamarine {
         Hyprutils::Memory::CUniquePointer<CGLTex>     tex;
         Hyprutils::Signal::CHyprSignalListener        bufferDestroy;
         std::vector<uint8_t>                          intermediateBuf;
+        bool                                          needsReadback = false; // not importable by the blitting gpu, has to go through the primary
+
 
         Hyprutils::Memory::CWeakPointer<CDRMRenderer> renderer;
     };
 
+    // State for reading back buffers the blitting gpu can't import, one per blit destination.
+    // The pack buffer and its fence belong to the primary (reading) renderer,
+    // the texture to the blitting one. The texture keeps the last frame, so only damaged rows move.
+    class CDRMReadback {
+      public:
+        CDRMReadback() = default;
+        ~CDRMReadback();
+
+        Hyprutils::Memory::CWeakPointer<CDRMRenderer> reader, uploader;
+        Hyprutils::Math::Vector2D                     size;
+        GLuint                                        pbo     = 0;
+        size_t                                        pboSize = 0;
+        GLsync                                        fence   = nullptr;
+        Hyprutils::Memory::CUniquePointer<CGLTex>     tex;
+        bool                                          texValid = false;
+
+        // rows [first, second) read this frame, in gl coordinates
+        std::vector<std::pair<int, int>> rows;
+    };
+
     // CEglContextGuard is a RAII abstraction for the EGL context.
     // On initialization, it sets the EGL context to the renderer's display,
     // and on destruction, it restores the previous EGL context.
@@ -96,8 +119,10 @@ namespace Aquamarine {
             std::optional<int> syncFD;
         };
 
+        // damage is in buffer pixels, only those rects are copied. nullopt copies everything.
         SBlitResult blit(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to,
-                         Hyprutils::Memory::CSharedPointer<CDRMRenderer> primaryRenderer, int waitFD = -1);
+                         Hyprutils::Memory::CSharedPointer<CDRMRenderer> primaryRenderer, int waitFD = -1,
+                         const std::optional<Hyprutils::Math::CRegion>& damage = std::nullopt, Hyprutils::Memory::CSharedPointer<CDRMReadback> readback = nullptr);
         // can't be a SP<> because we call it from buf's ctor...
         void clearBuffer(IBuffer* buf);
 
@@ -151,6 +176,10 @@ namespace Aquamarine {
 
         CGLTex                                        glTex(Hyprutils::Memory::CSharedPointer<IBuffer> buf);
         void                                          readBuffer(Hyprutils::Memory::CSharedPointer<IBuffer> buf, std::span<uint8_t> out);
+        // starts reading readback->rows of buf into the pack buffer, doesn't wait
+        bool                                          readBufferAsync(Hyprutils::Memory::CSharedPointer<IBuffer> buf, Hyprutils::Memory::CSharedPointer<CDRMReadback> readback);
+        // waits for readBufferAsync and calls fn with the mapped rows, starting at the first row of readback->rows
+        bool mapReadback(Hyprutils::Memory::CSharedPointer<CDRMReadback> readback, const std::function<void(const uint8_t*)>& fn);
 
         Hyprutils::Memory::CWeakPointer<CDRMRenderer> self;
         std::vector<SGLFormat>                        formats;
@@ -159,6 +188,7 @@ namespace Aquamarine {
         CDRMRenderer() = default;
 
         EGLImageKHR                                           createEGLImage(const SDMABUFAttrs& attrs);
+        GLuint                                                readFBO(Hyprutils::Memory::CSharedPointer<IBuffer> buf);
         bool                                                  verifyDestinationDMABUF(const SDMABUFAttrs& attrs);
         void                                                  waitOnSync(int fd);
         int                                                   recreateBlitSync();
@@ -1,4 +1,6 @@
 #include <aquamarine/backend/drm/Atomic.hpp>
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <drm_mode.h>
@@ -7,6 +9,7 @@
 #include <sys/mman.h>
 #include <sstream>
 #include "Shared.hpp"
+#include "../BlobCache.hpp"
 #include "aquamarine/output/Output.hpp"
 
 using namespace Aquamarine;
@@ -49,6 +52,21 @@ static uint8_t getMaxBPC(uint32_t drmFormat) {
     }
 }
 
+// both wl transforms and drm rotations are counter-clockwise
+static uint64_t transformToRotation(eTransform transform) {
+    switch (transform) {
+        case HYPRUTILS_TRANSFORM_NORMAL: return DRM_MODE_ROTATE_0;
+        case HYPRUTILS_TRANSFORM_90: return DRM_MODE_ROTATE_90;
+        case HYPRUTILS_TRANSFORM_180: return DRM_MODE_ROTATE_180;
+        case HYPRUTILS_TRANSFORM_270: return DRM_MODE_ROTATE_270;
+        case HYPRUTILS_TRANSFORM_FLIPPED: return DRM_MODE_ROTATE_0 | DRM_MODE_REFLECT_X;
+        case HYPRUTILS_TRANSFORM_FLIPPED_90: return DRM_MODE_ROTATE_90 | DRM_MODE_REFLECT_X;
+        case HYPRUTILS_TRANSFORM_FLIPPED_180: return DRM_MODE_ROTATE_180 | DRM_MODE_REFLECT_X;
+        case HYPRUTILS_TRANSFORM_FLIPPED_270: return DRM_MODE_ROTATE_270 | DRM_MODE_REFLECT_X;
+        default: return DRM_MODE_ROTATE_0;
+    }
+}
+
 Aquamarine::CDRMAtomicRequest::CDRMAtomicRequest(Hyprutils::Memory::CWeakPointer<CDRMBackend> backend_) : backend(backend_), req(drmModeAtomicAlloc()) {
     if (!req)
         failed = true;
@@ -120,8 +138,40 @@ void Aquamarine::CDRMAtomicRequest::planePropsPos(Hyprutils::Memory::CSharedPoin
     add(plane->id, plane->props.values.crtc_y, (uint64_t)pos.y);
 }
 
+void Aquamarine::CDRMAtomicRequest::planePropsLayer(Hyprutils::Memory::CSharedPointer<SDRMPlane> plane, Hyprutils::Memory::CSharedPointer<CDRMFB> fb,
+                                                    Hyprutils::Memory::CSharedPointer<SDRMCRTC> crtc, const SOutputLayer& layer) {
+
+    if (failed)
+        return;
+
+    const auto SRC = layer.src.w <= 0 || layer.src.h <= 0 ? CBox{{}, fb->buffer->size} : layer.src;
+
+    TRACE(backend->log(AQ_LOG_TRACE,
+                       std::format("atomic planePropsLayer: plane {}, src {}x{}+{}x{}, dst {}x{}+{}x{}, transform {}", plane->id, SRC.w, SRC.h, SRC.x, SRC.y, layer.dst.w,
+                                   layer.dst.h, layer.dst.x, layer.dst.y, (int)layer.transform)));
+
+    // src_ are 16.16 fixed point, crtc_x/y are signed
+    add(plane->id, plane->props.values.src_x, (uint64_t)(SRC.x * 65536.0));
+    add(plane->id, plane->props.values.src_y, (uint64_t)(SRC.y * 65536.0));
+    add(plane->id, plane->props.values.src_w, (uint64_t)(SRC.w * 65536.0));
+    add(plane->id, plane->props.values.src_h, (uint64_t)(SRC.h * 65536.0));
+    add(plane->id, plane->props.values.crtc_x, (uint64_t)(int64_t)std::round(layer.dst.x));
+    add(plane->id, plane->props.values.crtc_y, (uint64_t)(int64_t)std::round(layer.dst.y));
+    add(plane->id, plane->props.values.crtc_w, (uint64_t)std::round(layer.dst.w));
+    add(plane->id, plane->props.values.crtc_h, (uint64_t)std::round(layer.dst.h));
+    add(plane->id, plane->props.values.fb_id, fb->id);
+    add(plane->id, plane->props.values.crtc_id, crtc->id);
+
+    if (plane->props.values.rotation)
+        add(plane->id, plane->props.values.rotation, transformToRotation(layer.transform));
+
+    // whoever had the plane before may have moved it below the primary
+    if (auto it = std::ranges::find_if(crtc->overlayZpos, [&plane](const auto& z) { return z.first == plane->id; }); it != crtc->overlayZpos.end())
+        add(plane->id, plane->props.values.zpos, it->second);
+}
+
 void Aquamarine::CDRMAtomicRequest::setConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector) {
-    conn = connector;
+    conns = {{connector, nullptr}};
 }
 
 void Aquamarine::CDRMAtomicRequest::addConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) {
@@ -135,7 +185,7 @@ void Aquamarine::CDRMAtomicRequest::addConnector(Hyprutils::Memory::CSharedPoint
 
     TRACE(backend->log(AQ_LOG_TRACE, std::format("atomic addConnector values: CRTC {}, mode {}", enable ? connector->crtc->id : 0, data.atomic.modeBlob)));
 
-    conn = connector;
+    conns.emplace_back(connector, &data);
     if (enable) {
         drmModeModeInfo* currentMode = connector->getCurrentMode();
         bool             modeDiffers = true;
@@ -160,6 +210,7 @@ void Aquamarine::CDRMAtomicRequest::addConnector(Hyprutils::Memory::CSharedPoint
         addConnectorModeset(connector, data);
 
     addConnectorCursor(connector, data);
+    addConnectorOverlays(connector, data);
 
     add(connector->id, connector->props.values.crtc_id, enable ? connector->crtc->id : 0);
 
@@ -235,7 +286,28 @@ void Aquamarine::CDRMAtomicRequest::addConnectorCursor(Hyprutils::Memory::CShare
         planeProps(connector->crtc->cursor, nullptr, 0, {});
 }
 
-bool Aquamarine::CDRMAtomicRequest::commit(uint32_t flagssss) {
+void Aquamarine::CDRMAtomicRequest::addConnectorOverlays(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) {
+    const auto& STATE  = connector->output->state->state();
+    const bool  enable = STATE.enabled && data.mainFB;
+
+    // overlays stay as they are unless the layers were committed
+    if (enable && !data.overlaysChanged)
+        return;
+
+    for (auto const& plane : connector->crtc->overlays) {
+        auto it = std::ranges::find_if(data.overlays, [&plane](const auto& o) { return o.plane == plane; });
+        if (enable && it != data.overlays.end()) {
+            planePropsLayer(plane, it->fb, connector->crtc, *it->layer);
+            continue;
+        }
+
+        // don't touch planes another crtc is scanning out
+        if (plane->overlayCrtc == connector->crtc->id)
+            planeProps(plane, nullptr, 0, {});
+    }
+}
+
+bool Aquamarine::CDRMAtomicRequest::commit(uint32_t flagssss, SDRMPageFlip* pageFlip) {
     static auto flagsToStr = [](uint32_t flags) {
         std::ostringstream result;
         if (flags & DRM_MODE_ATOMIC_ALLOW_MODESET)
@@ -258,7 +330,14 @@ bool Aquamarine::CDRMAtomicRequest::commit(uint32_t flagssss) {
         return false;
     }
 
-    if (auto ret = drmModeAtomicCommit(backend->gpu->fd, req, flagssss, conn ? &conn->pendingPageFlip : nullptr); ret) {
+    // with more than one crtc, every one of them sends its own event with the same user data
+    void* userData = pageFlip;
+    if (!userData && conns.size() == 1)
+        userData = &conns.front().first->pendingPageFlip;
+    else if (!userData && conns.size() > 1)
+        userData = &backend->transactionPageFlip;
+
+    if (auto ret = drmModeAtomicCommit(backend->gpu->fd, req, flagssss, userData); ret) {
         backend->log((flagssss & DRM_MODE_ATOMIC_TEST_ONLY) ? AQ_LOG_DEBUG : AQ_LOG_ERROR,
                      std::format("atomic drm request: failed to commit: {}, flags: {}", strerror(ret == -1 ? errno : -ret), flagsToStr(flagssss)));
         return false;
@@ -275,43 +354,64 @@ void Aquamarine::CDRMAtomicRequest::destroyBlob(uint32_t id) {
         backend->log(AQ_LOG_ERROR, "atomic drm request: failed to destroy a blob");
 }
 
+// next holds a blob cache reference from prepareConnector, which either moves to *current or is dropped
 void Aquamarine::CDRMAtomicRequest::commitBlob(uint32_t* current, uint32_t next) {
-    if (*current == next)
+    if (*current == next) {
+        backend->blobCache->unref(next);
         return;
-    destroyBlob(*current);
+    }
+    backend->blobCache->unref(*current);
     *current = next;
 }
 
 void Aquamarine::CDRMAtomicRequest::rollbackBlob(uint32_t* current, uint32_t next) {
-    if (*current == next)
-        return;
-    destroyBlob(next);
+    backend->blobCache->unref(next);
 }
 
-void Aquamarine::CDRMAtomicRequest::rollback(SDRMConnectorCommitData& data) {
-    if (!conn)
-        return;
+void Aquamarine::CDRMAtomicRequest::rollback() {
+    for (auto const& [connector, data] : conns) {
+        if (data)
+            rollbackConnector(connector, *data);
+    }
+}
 
+void Aquamarine::CDRMAtomicRequest::apply() {
+    for (auto const& [connector, data] : conns) {
+        if (data)
+            applyConnector(connector, *data);
+    }
+}
+
+void Aquamarine::CDRMAtomicRequest::rollbackConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> conn, SDRMConnectorCommitData& data) {
     conn->crtc->atomic.ownModeID = true;
     if (data.atomic.blobbed)
         rollbackBlob(&conn->crtc->atomic.modeID, data.atomic.modeBlob);
-    rollbackBlob(&conn->crtc->atomic.gammaLut, data.atomic.gammaLut);
-    rollbackBlob(&conn->crtc->atomic.ctm, data.atomic.ctmBlob);
+    if (data.atomic.gammad)
+        rollbackBlob(&conn->crtc->atomic.gammaLut, data.atomic.gammaLut);
+    if (data.atomic.degammad)
+        rollbackBlob(&conn->crtc->atomic.degammaLut, data.atomic.degammaLut);
+    if (data.atomic.ctmd)
+        rollbackBlob(&conn->crtc->atomic.ctm, data.atomic.ctmBlob);
+    if (data.atomic.hdrd)
+        rollbackBlob(&conn->atomic.hdrBlob, data.atomic.hdrBlob);
     destroyBlob(data.atomic.fbDamage);
 }
 
-void Aquamarine::CDRMAtomicRequest::apply(SDRMConnectorCommitData& data) {
-    if (!conn)
-        return;
-
+void Aquamarine::CDRMAtomicRequest::applyConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> conn, SDRMConnectorCommitData& data) {
     if (!conn->crtc->atomic.ownModeID)
         conn->crtc->atomic.modeID = 0;
 
     conn->crtc->atomic.ownModeID = true;
     if (data.atomic.blobbed)
         commitBlob(&conn->crtc->atomic.modeID, data.atomic.modeBlob);
-    commitBlob(&conn->crtc->atomic.gammaLut, data.atomic.gammaLut);
-    commitBlob(&conn->crtc->atomic.ctm, data.atomic.ctmBlob);
+    if (data.atomic.gammad)
+        commitBlob(&conn->crtc->atomic.gammaLut, data.atomic.gammaLut);
+    if (data.atomic.degammad)
+        commitBlob(&conn->crtc->atomic.degammaLut, data.atomic.degammaLut);
+    if (data.atomic.ctmd)
+        commitBlob(&conn->crtc->atomic.ctm, data.atomic.ctmBlob);
+    if (data.atomic.hdrd)
+        commitBlob(&conn->atomic.hdrBlob, data.atomic.hdrBlob);
     destroyBlob(data.atomic.fbDamage);
 }
 
@@ -328,7 +428,8 @@ bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPoin
         if (!enable)
             data.atomic.modeBlob = 0;
         else {
-            if (drmModeCreatePropertyBlob(connector->backend->gpu->fd, &data.modeInfo, sizeof(drmModeModeInfo), &data.atomic.modeBlob)) {
+            data.atomic.modeBlob = backend->blobCache->acquire(CDRMBlobCache::AQ_DRM_BLOB_MODE, &data.modeInfo, sizeof(drmModeModeInfo));
+            if (!data.atomic.modeBlob) {
                 connector->backend->backend->log(AQ_LOG_ERROR, "atomic drm: failed to create a modeset blob");
                 return false;
             }
@@ -339,27 +440,34 @@ bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPoin
         }
     }
 
-    auto prepareGammaBlob = [connector](uint32_t prop, const std::vector<uint16_t>& gammaLut, uint32_t* blobId) -> bool {
+    auto prepareGammaBlob = [connector, this](uint32_t prop, const std::vector<uint16_t>& gammaLut, uint32_t* blobId) -> bool {
         if (!prop) // TODO: allow this with legacy gamma, perhaps.
             connector->backend->backend->log(AQ_LOG_ERROR, "atomic drm: failed to commit gamma: no gamma_lut prop");
         else if (gammaLut.empty()) {
             blobId = nullptr;
             return true;
         } else {
-            std::vector<drm_color_lut> lut;
-            lut.resize(gammaLut.size() / 3); // [r,g,b]+
-
-            for (size_t i = 0; i < lut.size(); ++i) {
-                lut.at(i).red      = gammaLut.at(i * 3 + 0);
-                lut.at(i).green    = gammaLut.at(i * 3 + 1);
-                lut.at(i).blue     = gammaLut.at(i * 3 + 2);
-                lut.at(i).reserved = 0;
-            }
+            // keyed on the raw lut, so a hit skips the conversion too
+            const std::span<const uint8_t> KEY{(const uint8_t*)gammaLut.data(), gammaLut.size() * sizeof(uint16_t)};
+
+            *blobId = backend->blobCache->acquire(CDRMBlobCache::AQ_DRM_BLOB_LUT, KEY, [&gammaLut] {
+                std::vector<uint8_t> payload;
+                payload.resize(gammaLut.size() / 3 * sizeof(drm_color_lut)); // [r,g,b]+
 
-            if (drmModeCreatePropertyBlob(connector->backend->gpu->fd, lut.data(), lut.size() * sizeof(drm_color_lut), blobId)) {
+                auto lut = (drm_color_lut*)payload.data();
+                for (size_t i = 0; i < gammaLut.size() / 3; ++i) {
+                    lut[i].red      = gammaLut.at(i * 3 + 0);
+                    lut[i].green    = gammaLut.at(i * 3 + 1);
+                    lut[i].blue     = gammaLut.at(i * 3 + 2);
+                    lut[i].reserved = 0;
+                }
+
+                return payload;
+            });
+
+            if (!*blobId)
                 connector->backend->backend->log(AQ_LOG_ERROR, "atomic drm: failed to create a gamma blob");
-                *blobId = 0;
-            } else
+            else
                 return true;
         }
 
@@ -388,10 +496,10 @@ bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPoin
                 ctm.matrix[i] = doubleToS3132Fixed(data.ctm->getMatrix()[i]);
             }
 
-            if (drmModeCreatePropertyBlob(connector->backend->gpu->fd, &ctm, sizeof(drm_color_ctm), &data.atomic.ctmBlob)) {
+            data.atomic.ctmBlob = backend->blobCache->acquire(CDRMBlobCache::AQ_DRM_BLOB_CTM, &ctm, sizeof(drm_color_ctm));
+            if (!data.atomic.ctmBlob)
                 connector->backend->backend->log(AQ_LOG_ERROR, "atomic drm: failed to create a ctm blob");
-                data.atomic.ctmBlob = 0;
-            } else
+            else
                 data.atomic.ctmd = true;
         }
     }
@@ -403,7 +511,8 @@ bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPoin
             if (!data.hdrMetadata->hdmi_metadata_type1.eotf) {
                 data.atomic.hdrBlob = 0;
                 data.atomic.hdrd    = true;
-            } else if (drmModeCreatePropertyBlob(connector->backend->gpu->fd, &data.hdrMetadata.value(), sizeof(hdr_output_metadata), &data.atomic.hdrBlob)) {
+            } else if (!(data.atomic.hdrBlob =
+                             backend->blobCache->acquire(CDRMBlobCache::AQ_DRM_BLOB_HDR_METADATA, &data.hdrMetadata.value(), sizeof(hdr_output_metadata)))) {
                 connector->backend->backend->log(AQ_LOG_ERROR, "atomic drm: failed to create a hdr metadata blob");
                 data.atomic.hdrBlob = 0;
                 data.atomic.hdrd    = false;
@@ -431,6 +540,11 @@ bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPoin
             std::vector<pixman_box32_t> rects = STATE.damage.copy().intersect(CBox{{}, MODE->pixelSize}).getRects();
             if (drmModeCreatePropertyBlob(connector->backend->gpu->fd, rects.data(), sizeof(pixman_box32_t) * rects.size(), &data.atomic.fbDamage)) {
                 connector->backend->backend->log(AQ_LOG_ERROR, "atomic drm: failed to create a damage blob");
+
+                // nothing will roll these back
+                for (auto const& id : {data.atomic.modeBlob, data.atomic.gammaLut, data.atomic.degammaLut, data.atomic.ctmBlob, data.atomic.hdrBlob}) {
+                    backend->blobCache->unref(id);
+                }
                 return false;
             }
         }
@@ -440,29 +554,44 @@ bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPoin
 }
 
 bool Aquamarine::CDRMAtomicImpl::commit(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) {
-    if (!prepareConnector(connector, data))
-        return false;
+    return commitConnectors({{connector, &data}}, data.test);
+}
 
+bool Aquamarine::CDRMAtomicImpl::commitConnectors(const std::vector<std::pair<SP<SDRMConnector>, SDRMConnectorCommitData*>>& connectors, bool test) {
     CDRMAtomicRequest request(backend);
 
-    request.addConnector(connector, data);
+    uint32_t flags    = 0;
+    bool     blocking = false;
+
+    for (auto const& [connector, data] : connectors) {
+        if (!prepareConnector(connector, *data)) {
+            request.rollback();
+            return false;
+        }
+
+        request.addConnector(connector, *data);
 
-    uint32_t flags = data.flags;
-    if (data.test)
+        flags |= data->flags;
+        if (data->modeset)
+            flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+        blocking = blocking || data->blocking;
+    }
+
+    if (test)
         flags |= DRM_MODE_ATOMIC_TEST_ONLY;
-    if (data.modeset)
-        flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
-    if (!data.blocking && !data.test)
+    if (!blocking && !test)
         flags |= DRM_MODE_ATOMIC_NONBLOCK;
 
     const bool ok = request.commit(flags);
 
     if (ok) {
-        request.apply(data);
-        if (!data.test && data.mainFB && connector->output->state->state().enabled && (flags & DRM_MODE_PAGE_FLIP_EVENT))
-            connector->isPageFlipPending = true;
+        request.apply();
+        for (auto const& [connector, data] : connectors) {
+            if (!test && data->mainFB && connector->output->state->state().enabled && (data->flags & DRM_MODE_PAGE_FLIP_EVENT))
+                connector->isPageFlipPending = true;
+        }
     } else
-        request.rollback(data);
+        request.rollback();
 
     return ok;
 }
@@ -486,14 +615,92 @@ bool Aquamarine::CDRMAtomicImpl::reset() {
     return request.commit(DRM_MODE_ATOMIC_ALLOW_MODESET);
 }
 
+bool Aquamarine::CDRMAtomicImpl::restore(const std::vector<std::pair<SP<SDRMConnector>, SDRMConnectorCommitData*>>& connectors) {
+    CDRMAtomicRequest request(backend);
+
+    auto ours = [&connectors](auto pred) { return std::ranges::any_of(connectors, [&pred](const auto& c) { return pred(c.first); }); };
+
+    // whoever had the device may have left anything on. What we restore is set below, the rest goes off
+    // in the same request instead of a reset() beforehand, so outputs don't blank twice.
+    for (auto const& crtc : backend->crtcs) {
+        if (ours([&crtc](const auto& c) { return c->crtc == crtc; }))
+            continue;
+
+        request.add(crtc->id, crtc->props.values.mode_id, 0);
+        request.add(crtc->id, crtc->props.values.active, 0);
+    }
+
+    for (auto const& conn : backend->connectors) {
+        if (ours([&conn](const auto& c) { return c == conn; }))
+            continue;
+
+        request.add(conn->id, conn->props.values.crtc_id, 0);
+    }
+
+    for (auto const& plane : backend->planes) {
+        if (ours([&plane](const auto& c) { return c->crtc->primary == plane; }))
+            continue;
+
+        request.planeProps(plane, nullptr, 0, {});
+    }
+
+    // luts, ctm and metadata the state doesn't set again are put back from what we had, the blobs outlived the switch
+    auto keep = [this](uint32_t current, uint32_t* next, bool* changed) {
+        if (*changed)
+            return;
+
+        backend->blobCache->ref(current);
+        *next    = current;
+        *changed = true;
+    };
+
+    for (auto const& [connector, data] : connectors) {
+        if (!prepareConnector(connector, *data)) {
+            request.rollback();
+            return false;
+        }
+
+        keep(connector->crtc->atomic.gammaLut, &data->atomic.gammaLut, &data->atomic.gammad);
+        keep(connector->crtc->atomic.degammaLut, &data->atomic.degammaLut, &data->atomic.degammad);
+        keep(connector->crtc->atomic.ctm, &data->atomic.ctmBlob, &data->atomic.ctmd);
+        keep(connector->atomic.hdrBlob, &data->atomic.hdrBlob, &data->atomic.hdrd);
+
+        request.addConnector(connector, *data);
+    }
+
+    if (!request.commit(DRM_MODE_ATOMIC_ALLOW_MODESET)) {
+        request.rollback();
+        return false;
+    }
+
+    request.apply();
+
+    return true;
+}
+
 bool Aquamarine::CDRMAtomicImpl::moveCursor(SP<SDRMConnector> connector, bool skipSchedule) {
     if (!connector->output->cursorVisible || !connector->output->state->state().enabled || !connector->crtc || !connector->crtc->cursor)
         return true;
 
     if (!skipSchedule) {
         TRACE(connector->backend->log(AQ_LOG_TRACE, "atomic moveCursor"));
-        connector->output->scheduleFrame(IOutput::AQ_SCHEDULE_CURSOR_MOVE);
+        connector->output->cursorCommit.dirty = true;
+        connector->output->scheduleCursorCommit();
     }
 
     return true;
 }
+
+bool Aquamarine::CDRMAtomicImpl::commitCursor(SP<SDRMConnector> connector) {
+    const auto& OUTPUT = connector->output;
+
+    // the crtc has to be in the request for the event, setting the plane's crtc_id pulls it in
+    CDRMAtomicRequest request(backend);
+    request.planeProps(connector->crtc->cursor, connector->crtc->cursor->front, connector->crtc->id, OUTPUT->cursorPos - OUTPUT->cursorHotspot);
+
+    if (!request.commit(DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, &connector->cursorPageFlip))
+        return false;
+
+    connector->cursorFlipPending = true;
+    return true;
+}
@@ -142,6 +142,11 @@ void Aquamarine::COutputState::setContentType(const uint16_t drmContentType) {
     internalState.contentType = drmContentType;
 }
 
+void Aquamarine::COutputState::setLayers(const std::vector<Hyprutils::Memory::CSharedPointer<SOutputLayer>>& layers) {
+    internalState.layers = layers;
+    internalState.committed |= AQ_OUTPUT_STATE_LAYERS;
+}
+
 void Aquamarine::COutputState::onCommit() {
     internalState.committed = 0;
     internalState.damage.clear();
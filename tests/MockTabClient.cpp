@@ -0,0 +1,393 @@
+#include "MockTabClient.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <vector>
+#include <drm_fourcc.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+extern "C" {
+#include <tab_client.h>
+}
+
+struct SMockTarget {
+    int      fd     = -1;
+    uint32_t stride = 0;
+
+    enum eState : uint8_t {
+        FREE,     // can be acquired
+        ACQUIRED, // the client renders into it
+        FRONT,    // swapped, the server shows it until the next swap
+    } state = FREE;
+};
+
+struct SMockMonitor {
+    std::string                id;
+    uint32_t                   width = 0, height = 0;
+    double                     refreshHz = 60.0;
+    std::array<SMockTarget, 3> targets;
+    size_t                     nextTarget = 0;
+    std::deque<size_t>         acquired; // in acquire order, the next swap presents the front one
+    bool                       frameDonePending = false; // swapped, and the client hasn't read the FRAME_DONE yet
+    uint64_t                   seq              = 0;
+};
+
+struct TabClientHandle {
+    int                  fds[2] = {-1, -1}; // [0] is handed to the backend, [1] is the "server" end
+    std::deque<TabEvent> queue;
+};
+
+static struct {
+    std::vector<SMockMonitor> monitors;
+    TabClientHandle*          client = nullptr;
+    MockTab::SStats           stats;
+} g_mock;
+
+static uint64_t nowUsec() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static SMockMonitor* monitorFromID(const char* id) {
+    if (!id)
+        return nullptr;
+
+    auto it = std::ranges::find_if(g_mock.monitors, [id](const auto& m) { return m.id == id; });
+    return it == g_mock.monitors.end() ? nullptr : &*it;
+}
+
+static TabMonitorInfo infoFor(const SMockMonitor& mon) {
+    TabMonitorInfo info = {};
+    info.id             = strdup(mon.id.c_str());
+    info.name           = strdup(mon.id.c_str());
+    info.width          = mon.width;
+    info.height         = mon.height;
+    info.refresh_rate   = mon.refreshHz;
+    info.cursor_width   = 64;
+    info.cursor_height  = 64;
+    return info;
+}
+
+// events sent in reply to a synchronous call are read by the client while it waits for the
+// reply, so they end up in the queue without leaving anything on the socket
+static void queueEvent(const TabEvent& event, bool wake = true) {
+    if (!g_mock.client)
+        return;
+
+    g_mock.client->queue.emplace_back(event);
+    g_mock.stats.eventsQueued++;
+
+    if (!wake)
+        return;
+
+    // one byte per event, if the socket is full it's readable anyways
+    const char WAKE = 1;
+    write(g_mock.client->fds[1], &WAKE, 1);
+}
+
+static void destroyTargets(SMockMonitor& mon) {
+    for (auto& t : mon.targets) {
+        if (t.fd >= 0)
+            close(t.fd);
+        t.fd = -1;
+    }
+}
+
+static void createTargets(SMockMonitor& mon) {
+    for (auto& t : mon.targets) {
+        t.stride = mon.width * 4;
+        t.fd     = memfd_create("mock-tab-target", MFD_CLOEXEC);
+        if (t.fd >= 0)
+            ftruncate(t.fd, (off_t)t.stride * mon.height);
+    }
+}
+
+void MockTab::addMonitor(const std::string& id, uint32_t width, uint32_t height, double refreshHz) {
+    auto& mon     = g_mock.monitors.emplace_back();
+    mon.id        = id;
+    mon.width     = width;
+    mon.height    = height;
+    mon.refreshHz = refreshHz;
+    createTargets(mon);
+
+    TabEvent event           = {};
+    event.event_type         = TAB_EVENT_MONITOR_ADDED;
+    event.data.monitor_added = infoFor(mon);
+    if (g_mock.client)
+        queueEvent(event);
+    else
+        tab_client_free_monitor_info(&event.data.monitor_added);
+}
+
+void MockTab::removeMonitor(const std::string& id) {
+    auto it = std::ranges::find_if(g_mock.monitors, [&id](const auto& m) { return m.id == id; });
+    if (it == g_mock.monitors.end())
+        return;
+
+    destroyTargets(*it);
+    g_mock.monitors.erase(it);
+
+    TabEvent event             = {};
+    event.event_type           = TAB_EVENT_MONITOR_REMOVED;
+    event.data.monitor_removed = strdup(id.c_str());
+    queueEvent(event);
+}
+
+void MockTab::pushPointerMotion(double dx, double dy) {
+    TabEvent event        = {};
+    event.event_type      = TAB_EVENT_INPUT;
+    event.data.input.kind = TAB_INPUT_KIND_POINTER_MOTION;
+    auto& motion          = event.data.input.data.pointer_motion;
+    motion.time_usec      = nowUsec();
+    motion.dx             = dx;
+    motion.dy             = dy;
+    motion.unaccel_dx     = dx;
+    motion.unaccel_dy     = dy;
+    queueEvent(event);
+}
+
+void MockTab::pushKey(uint32_t key, bool pressed) {
+    TabEvent event        = {};
+    event.event_type      = TAB_EVENT_INPUT;
+    event.data.input.kind = TAB_INPUT_KIND_KEY;
+    auto& k               = event.data.input.data.key;
+    k.time_usec           = nowUsec();
+    k.key                 = key;
+    k.state               = pressed ? TAB_KEY_PRESSED : TAB_KEY_RELEASED;
+    queueEvent(event);
+}
+
+size_t MockTab::acquiredTargets() {
+    size_t held = 0;
+    for (auto const& m : g_mock.monitors) {
+        held += m.acquired.size();
+    }
+    return held;
+}
+
+const MockTab::SStats& MockTab::stats() {
+    return g_mock.stats;
+}
+
+void MockTab::resetStats() {
+    g_mock.stats = {};
+}
+
+// the tab_client api
+
+extern "C" {
+
+TabClientHandle* tab_client_connect_default(const char* token) {
+    if (g_mock.client)
+        return nullptr;
+
+    auto client = new TabClientHandle();
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, client->fds) != 0) {
+        delete client;
+        return nullptr;
+    }
+
+    g_mock.client = client;
+    return client;
+}
+
+void tab_client_disconnect(TabClientHandle* client) {
+    if (!client)
+        return;
+
+    close(client->fds[0]);
+    close(client->fds[1]);
+    if (g_mock.client == client)
+        g_mock.client = nullptr;
+    delete client;
+}
+
+int tab_client_get_socket_fd(TabClientHandle* client) {
+    return client ? client->fds[0] : -1;
+}
+
+int tab_client_drm_fd(TabClientHandle* client) {
+    return -1;
+}
+
+size_t tab_client_get_monitor_count(TabClientHandle* client) {
+    return g_mock.monitors.size();
+}
+
+char* tab_client_get_monitor_id(TabClientHandle* client, size_t idx) {
+    if (idx >= g_mock.monitors.size())
+        return nullptr;
+    return strdup(g_mock.monitors.at(idx).id.c_str());
+}
+
+TabMonitorInfo tab_client_get_monitor_info(TabClientHandle* client, const char* monitor_id) {
+    if (auto mon = monitorFromID(monitor_id))
+        return infoFor(*mon);
+    return TabMonitorInfo{};
+}
+
+void tab_client_free_monitor_info(TabMonitorInfo* info) {
+    free((void*)info->id);
+    free((void*)info->name);
+    info->id   = nullptr;
+    info->name = nullptr;
+}
+
+void tab_client_string_free(char* str) {
+    free(str);
+}
+
+size_t tab_client_get_formats(TabClientHandle* client, TabFormatModifier** out) {
+    static const std::array<TabFormatModifier, 2> FORMATS = {{
+        {.fourcc = DRM_FORMAT_XRGB8888, .modifier = DRM_FORMAT_MOD_LINEAR},
+        {.fourcc = DRM_FORMAT_ARGB8888, .modifier = DRM_FORMAT_MOD_LINEAR},
+    }};
+
+    *out = (TabFormatModifier*)malloc(sizeof(FORMATS));
+    memcpy(*out, FORMATS.data(), sizeof(FORMATS));
+    return FORMATS.size();
+}
+
+void tab_client_free_formats(TabFormatModifier* formats, size_t count) {
+    free(formats);
+}
+
+bool tab_client_supports_explicit_sync(TabClientHandle* client) {
+    return false;
+}
+
+size_t tab_client_poll_events(TabClientHandle* client) {
+    char buf[512];
+    while (read(client->fds[0], buf, sizeof(buf)) > 0) {
+        ;
+    }
+
+    return client->queue.size();
+}
+
+bool tab_client_next_event(TabClientHandle* client, TabEvent* event) {
+    if (client->queue.empty())
+        return false;
+
+    *event = client->queue.front();
+    client->queue.pop_front();
+    g_mock.stats.eventsPolled++;
+
+    if (event->event_type == TAB_EVENT_FRAME_DONE) {
+        if (auto mon = monitorFromID(event->data.frame_done.monitor_id))
+            mon->frameDonePending = false;
+    }
+
+    return true;
+}
+
+TabAcquireResult tab_client_acquire_frame(TabClientHandle* client, const char* monitor_id, TabFrameTarget* target) {
+    auto mon = monitorFromID(monitor_id);
+    if (!mon)
+        return TAB_ACQUIRE_ERROR;
+
+    // the client should wait for FRAME_DONE before starting its next frame
+    if (mon->frameDonePending)
+        g_mock.stats.earlyAcquires++;
+
+    size_t idx = mon->nextTarget;
+    for (size_t i = 0; i < mon->targets.size() && mon->targets.at(idx).state != SMockTarget::FREE; ++i) {
+        idx = (idx + 1) % mon->targets.size();
+    }
+
+    if (mon->targets.at(idx).state != SMockTarget::FREE) {
+        g_mock.stats.failedAcquires++;
+        return TAB_ACQUIRE_ERROR;
+    }
+
+    auto& T         = mon->targets.at(idx);
+    T.state         = SMockTarget::ACQUIRED;
+    mon->nextTarget = (idx + 1) % mon->targets.size();
+    mon->acquired.emplace_back(idx);
+
+    *target                  = {};
+    target->width            = mon->width;
+    target->height           = mon->height;
+    target->dmabuf.fd        = T.fd;
+    target->dmabuf.stride    = T.stride;
+    target->dmabuf.offset    = 0;
+    target->dmabuf.fourcc    = DRM_FORMAT_XRGB8888;
+    target->release_fence_fd = -1;
+
+    g_mock.stats.acquires++;
+    return TAB_ACQUIRE_OK;
+}
+
+static bool completeSwap(const char* monitor_id) {
+    auto mon = monitorFromID(monitor_id);
+    if (!mon)
+        return false;
+
+    // a swap presents a target the client acquired, there is nothing to show otherwise
+    if (mon->acquired.empty()) {
+        g_mock.stats.failedSwaps++;
+        return false;
+    }
+
+    for (auto& t : mon->targets) {
+        if (t.state == SMockTarget::FRONT)
+            t.state = SMockTarget::FREE;
+    }
+
+    mon->targets.at(mon->acquired.front()).state = SMockTarget::FRONT;
+    mon->acquired.pop_front();
+    mon->frameDonePending = true;
+
+    g_mock.stats.swaps++;
+
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    TabEvent event                   = {};
+    event.event_type                 = TAB_EVENT_FRAME_DONE;
+    event.data.frame_done.monitor_id = strdup(monitor_id);
+    event.data.frame_done.tv_sec     = ts.tv_sec;
+    event.data.frame_done.tv_nsec    = ts.tv_nsec;
+    event.data.frame_done.sequence   = ++mon->seq;
+    event.data.frame_done.refresh_ns = (uint32_t)(1000000000.0 / mon->refreshHz);
+    event.data.frame_done.flags      = TAB_PRESENT_VSYNC | TAB_PRESENT_HW_CLOCK;
+    queueEvent(event, false);
+
+    return true;
+}
+
+bool tab_client_swap_buffers(TabClientHandle* client, const char* monitor_id) {
+    return completeSwap(monitor_id);
+}
+
+bool tab_client_swap_buffers_with_damage(TabClientHandle* client, const char* monitor_id, const TabDamageRect* rects, size_t count) {
+    g_mock.stats.damagedSwaps++;
+    return completeSwap(monitor_id);
+}
+
+bool tab_client_swap_buffers_explicit(TabClientHandle* client, const char* monitor_id, const TabDamageRect* rects, size_t count, int32_t in_fence_fd, int32_t* out_fence_fd) {
+    if (out_fence_fd)
+        *out_fence_fd = -1;
+    if (count > 0)
+        g_mock.stats.damagedSwaps++;
+    return completeSwap(monitor_id);
+}
+
+bool tab_client_set_cursor(TabClientHandle* client, const char* monitor_id, const TabCursorBuffer* buffer) {
+    g_mock.stats.cursorUpdates++;
+    return monitorFromID(monitor_id);
+}
+
+bool tab_client_move_cursor(TabClientHandle* client, const char* monitor_id, int32_t x, int32_t y) {
+    g_mock.stats.cursorMoves++;
+    return monitorFromID(monitor_id);
+}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// An in-process stand-in for a Shift server, implementing the tab_client C API.
+// Link MockTabClient.cpp into an executable with ENABLE_EXPORTS and its tab_client_*
+// symbols take precedence over the real client library inside libaquamarine.
+//
+// Frame targets are memfds, so no gpu or drm node is needed. Swaps complete
+// immediately with a FRAME_DONE carrying a CLOCK_MONOTONIC timestamp. Like the
+// real client, that FRAME_DONE is queued during the swap and doesn't wake the socket.
+//
+// Each monitor has 3 targets. A target is busy from its acquire until the swap after
+// the one that presented it, so a client that leaks acquires runs out of targets.
+
+namespace MockTab {
+    struct SStats {
+        uint64_t acquires       = 0;
+        uint64_t failedAcquires = 0; // no free target, every one was acquired or on screen
+        uint64_t earlyAcquires  = 0; // acquired before the previous swap's FRAME_DONE was read
+        uint64_t swaps          = 0;
+        uint64_t failedSwaps    = 0; // swapped without an acquired target
+        uint64_t damagedSwaps   = 0;
+        uint64_t cursorUpdates  = 0;
+        uint64_t cursorMoves    = 0;
+        uint64_t eventsQueued   = 0;
+        uint64_t eventsPolled   = 0;
+    };
+
+    // monitors added before the backend starts are enumerated on connect,
+    // afterwards they are announced with MONITOR_ADDED / MONITOR_REMOVED
+    void          addMonitor(const std::string& id, uint32_t width, uint32_t height, double refreshHz);
+    void          removeMonitor(const std::string& id);
+
+    void          pushPointerMotion(double dx, double dy);
+    void          pushKey(uint32_t key, bool pressed);
+
+    // targets acquired by the client and not swapped yet
+    size_t        acquiredTargets();
+
+    const SStats& stats();
+    void          resetStats();
+};
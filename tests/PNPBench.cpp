@@ -0,0 +1,137 @@
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <new>
+#include <string>
+#include <sys/resource.h>
+#include <unordered_map>
+#include <vector>
+#include "hwdata.hpp"
+#include "shared.hpp"
+
+// Compares the pnp id table in hwdata.hpp against the std::unordered_map<std::string, std::string> it used to be.
+// The map was built by a static constructor in every process loading the library, so its build time and heap
+// are what loading used to cost. The table is constant data and costs neither.
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t BUILDS  = 50;
+constexpr size_t LOOKUPS = 1000000;
+
+static size_t g_allocated   = 0;
+static size_t g_allocations = 0;
+
+void* operator new(size_t size) {
+    g_allocated += size;
+    g_allocations++;
+
+    if (auto p = std::malloc(size))
+        return p;
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+static long maxRSSKb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static double toUs(Clock::duration d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+// what the old hwdata.hpp expanded to
+static std::unordered_map<std::string, std::string> buildMap() {
+    std::unordered_map<std::string, std::string> map;
+    for (auto const& e : PNPIDS) {
+        map.emplace(std::string{e.id}, std::string{e.vendor});
+    }
+    return map;
+}
+
+int main(int argc, char** argv, char** envp) {
+    int ret = 0;
+
+    if (PNPIDS.empty()) {
+        std::cout << "No pnp ids, hwdata missing at configure time? Nothing to compare\n";
+        return 0;
+    }
+
+    size_t stringBytes = 0;
+    for (auto const& e : PNPIDS) {
+        stringBytes += e.id.size() + e.vendor.size() + 2;
+    }
+
+    std::cout << std::format("table: {} ids, {} bytes of constant data\n", PNPIDS.size(), sizeof(PNPIDS) + stringBytes);
+
+    // load time
+    {
+        const auto RSS         = maxRSSKb();
+        const auto ALLOCATED   = g_allocated;
+        const auto ALLOCATIONS = g_allocations;
+        auto       map         = buildMap();
+
+        std::cout << std::format("map: {} heap allocations, {} bytes, max rss +{}KiB\n", g_allocations - ALLOCATIONS, g_allocated - ALLOCATED, maxRSSKb() - RSS);
+
+        const auto START = Clock::now();
+        for (size_t i = 0; i < BUILDS; ++i) {
+            auto m = buildMap();
+        }
+
+        std::cout << std::format("map: {:.1f}us to build, at every load\n", toUs(Clock::now() - START) / BUILDS);
+
+        size_t mismatches = 0;
+        for (auto const& e : PNPIDS) {
+            if (pnpVendor(e.id) != map.at(std::string{e.id}))
+                mismatches++;
+        }
+
+        EXPECT(mismatches, 0);
+        EXPECT(pnpVendor("???").has_value(), false);
+    }
+
+    // lookups, every known id in turn plus as many misses, like parseEDID does them
+    {
+        std::vector<std::string> ids;
+        for (auto const& e : PNPIDS) {
+            ids.emplace_back(e.id);
+            ids.emplace_back(std::string{e.id.substr(0, 2)} + "@");
+        }
+
+        auto   map   = buildMap();
+        size_t found = 0;
+        auto   START = Clock::now();
+        for (size_t i = 0; i < LOOKUPS; ++i) {
+            const auto& ID = ids.at(i % ids.size());
+            if (map.contains(ID))
+                found += map.at(ID).size();
+        }
+        const auto MAP = Clock::now() - START;
+
+        const auto ALLOCATIONS = g_allocations;
+
+        START = Clock::now();
+        for (size_t i = 0; i < LOOKUPS; ++i) {
+            if (const auto VENDOR = pnpVendor(ids.at(i % ids.size())))
+                found -= VENDOR->size();
+        }
+        const auto TABLE = Clock::now() - START;
+
+        EXPECT(found, 0);
+        EXPECT(g_allocations - ALLOCATIONS, 0);
+
+        std::cout << std::format("lookup: map {:.1f}ns, table {:.1f}ns\n", toUs(MAP) * 1000.0 / LOOKUPS, toUs(TABLE) * 1000.0 / LOOKUPS);
+    }
+
+    return ret;
+}
@@ -0,0 +1,260 @@
+#include <aquamarine/backend/Backend.hpp>
+#include <aquamarine/output/Output.hpp>
+#include <aquamarine/input/Input.hpp>
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <poll.h>
+#include <sys/resource.h>
+#include <unordered_map>
+#include <vector>
+#include "MockTabClient.hpp"
+#include "shared.hpp"
+
+// Drives CTabBackend against the in-process mock server in MockTabClient.cpp:
+// monitor hotplug, acquire / swap / FRAME_DONE round trips, and input bursts.
+// Needs no gpu, so it can run in CI.
+
+using namespace Hyprutils::Signal;
+using namespace Hyprutils::Memory;
+#define SP CSharedPointer
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t FRAMES_PER_OUTPUT = 1000;
+constexpr size_t HOTPLUG_CYCLES    = 200;
+constexpr size_t INPUT_EVENTS      = 200000;
+constexpr size_t INPUT_BURST       = 1000;
+constexpr double REFRESH_HZ        = 1000.0; // high, so that pacing doesn't dominate the run time
+
+struct SOutputBench {
+    SP<Aquamarine::IOutput> output;
+    CHyprSignalListener     frameListener, presentListener, destroyListener;
+    Clock::time_point       swapped;
+    size_t                  presented = 0;
+    bool                    destroyed = false;
+};
+
+static SP<Aquamarine::CBackend>                      g_backend;
+static std::vector<SP<Aquamarine::SPollFD>>          g_fds;
+static std::unordered_map<std::string, SOutputBench> g_outputs;
+static std::vector<Clock::duration>                  g_roundTrips;
+static size_t                                        g_inputEvents = 0;
+static bool                                          g_rendering   = false;
+
+static void aqLog(Aquamarine::eBackendLogLevel level, std::string msg) {
+    if (level == Aquamarine::AQ_LOG_ERROR || level == Aquamarine::AQ_LOG_CRITICAL)
+        std::cout << "[AQ] " << msg << "\n";
+}
+
+static double cpuSeconds() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+static double toUs(Clock::duration d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+// a tiny event loop: poll the backend's fds and dispatch until done() or the timeout
+static bool runUntil(const std::function<bool()>& done, std::chrono::milliseconds timeout = std::chrono::milliseconds{10000}) {
+    const auto          DEADLINE = Clock::now() + timeout;
+    std::vector<pollfd> pfds;
+
+    while (!done()) {
+        if (Clock::now() > DEADLINE)
+            return false;
+
+        pfds.clear();
+        for (auto const& fd : g_fds) {
+            pfds.emplace_back(pollfd{.fd = fd->fd, .events = POLLIN});
+        }
+
+        if (poll(pfds.data(), pfds.size(), 100) <= 0)
+            continue;
+
+        // copy, as dispatching may change g_fds
+        auto fds = g_fds;
+        for (size_t i = 0; i < pfds.size(); ++i) {
+            if (pfds[i].revents & POLLIN)
+                fds[i]->onSignal();
+        }
+    }
+
+    return true;
+}
+
+static void onNewOutput(SP<Aquamarine::IOutput> output) {
+    auto& bench     = g_outputs[output->name];
+    bench.output    = output;
+    bench.presented = 0;
+
+    bench.frameListener = output->events.frame.listen([&bench] {
+        if (!g_rendering || bench.presented >= FRAMES_PER_OUTPUT)
+            return;
+
+        auto buf = bench.output->swapchain->next(nullptr);
+        if (!buf)
+            return;
+
+        bench.output->state->setBuffer(buf);
+        bench.output->state->addDamage(Hyprutils::Math::CBox{0, 0, 64, 64});
+        bench.swapped = Clock::now();
+        bench.output->commit();
+    });
+
+    bench.presentListener = output->events.present.listen([&bench](const Aquamarine::IOutput::SPresentEvent& ev) {
+        if (!g_rendering)
+            return;
+
+        g_roundTrips.emplace_back(Clock::now() - bench.swapped);
+        bench.presented++;
+
+        if (bench.presented < FRAMES_PER_OUTPUT)
+            bench.output->scheduleFrame();
+    });
+
+    bench.destroyListener = output->events.destroy.listen([&bench] { bench.destroyed = true; });
+}
+
+int main(int argc, char** argv, char** envp) {
+    int                         ret = 0;
+
+    Aquamarine::SBackendOptions options;
+    options.logFunction = aqLog;
+
+    Aquamarine::SBackendImplementationOptions tabOptions;
+    tabOptions.backendType        = Aquamarine::eBackendType::AQ_BACKEND_TAB;
+    tabOptions.backendRequestMode = Aquamarine::eBackendRequestMode::AQ_BACKEND_REQUEST_MANDATORY;
+
+    MockTab::addMonitor("mock-0", 1920, 1080, REFRESH_HZ);
+    MockTab::addMonitor("mock-1", 2560, 1440, REFRESH_HZ);
+
+    g_backend = Aquamarine::CBackend::create({tabOptions}, options);
+    if (!g_backend) {
+        std::cout << "Failed to create the aq backend\n";
+        return 1;
+    }
+
+    CHyprSignalListener newOutputListener = g_backend->events.newOutput.listen([](const SP<Aquamarine::IOutput>& output) { onNewOutput(output); });
+    CHyprSignalListener pollFDsListener   = g_backend->events.pollFDsChanged.listen([] { g_fds = g_backend->getPollFDs(); });
+    CHyprSignalListener motionListener, pointerListener, keyboardListener, keyListener;
+
+    pointerListener = g_backend->events.newPointer.listen([&motionListener](const SP<Aquamarine::IPointer>& pointer) {
+        motionListener = pointer->events.move.listen([](const Aquamarine::IPointer::SMoveEvent& ev) { g_inputEvents++; });
+    });
+    keyboardListener = g_backend->events.newKeyboard.listen([&keyListener](const SP<Aquamarine::IKeyboard>& keyboard) {
+        keyListener = keyboard->events.key.listen([](const Aquamarine::IKeyboard::SKeyEvent& ev) { g_inputEvents++; });
+    });
+
+    if (!g_backend->start()) {
+        std::cout << "Failed to start the aq backend\n";
+        return 1;
+    }
+
+    g_fds = g_backend->getPollFDs();
+
+    EXPECT(g_outputs.size(), 2);
+
+    // drain the initial frame events before measuring
+    runUntil([] { return false; }, std::chrono::milliseconds{50});
+
+    // frame round trips: frame -> acquire -> swap -> FRAME_DONE -> present
+    {
+        MockTab::resetStats();
+        g_rendering = true;
+
+        const auto CPU   = cpuSeconds();
+        const auto START = Clock::now();
+
+        for (auto& [name, bench] : g_outputs) {
+            bench.output->scheduleFrame();
+        }
+
+        const bool DONE = runUntil([] { return std::ranges::all_of(g_outputs, [](const auto& o) { return o.second.presented >= FRAMES_PER_OUTPUT; }); });
+        const auto WALL = Clock::now() - START;
+        const auto CPUS = cpuSeconds() - CPU;
+
+        g_rendering = false;
+
+        EXPECT(DONE, true);
+
+        // flow control: one acquire per frame, after the previous FRAME_DONE, and every acquired target swapped
+        EXPECT(MockTab::stats().failedAcquires, 0);
+        EXPECT(MockTab::stats().earlyAcquires, 0);
+        EXPECT(MockTab::stats().failedSwaps, 0);
+        EXPECT(MockTab::acquiredTargets(), 0);
+
+        std::ranges::sort(g_roundTrips);
+        const size_t FRAMES = g_roundTrips.size();
+        if (FRAMES > 0) {
+            Clock::duration total{};
+            for (auto const& d : g_roundTrips) {
+                total += d;
+            }
+
+            std::cout << std::format("frames: {} over {} outputs in {:.1f}ms, {:.0f} fps total\n", FRAMES, g_outputs.size(), toUs(WALL) / 1000.0,
+                                     FRAMES / std::chrono::duration<double>(WALL).count());
+            std::cout << std::format("frame round trip: avg {:.1f}us, p50 {:.1f}us, p99 {:.1f}us, max {:.1f}us\n", toUs(total) / FRAMES, toUs(g_roundTrips[FRAMES / 2]),
+                                     toUs(g_roundTrips[FRAMES * 99 / 100]), toUs(g_roundTrips.back()));
+            std::cout << std::format("cpu per frame: {:.2f}us\n", CPUS * 1000000.0 / FRAMES);
+            std::cout << std::format("server: {} acquires, {} swaps ({} with damage)\n", MockTab::stats().acquires, MockTab::stats().swaps, MockTab::stats().damagedSwaps);
+        }
+    }
+
+    // monitor hotplug
+    {
+        const auto CPU   = cpuSeconds();
+        const auto START = Clock::now();
+        bool       ok    = true;
+
+        for (size_t i = 0; i < HOTPLUG_CYCLES && ok; ++i) {
+            MockTab::addMonitor("mock-hotplug", 1280, 720, REFRESH_HZ);
+            ok = runUntil([] { return g_outputs.contains("mock-hotplug"); });
+            MockTab::removeMonitor("mock-hotplug");
+            ok = ok && runUntil([] { return g_outputs.at("mock-hotplug").destroyed; });
+            g_outputs.erase("mock-hotplug");
+        }
+
+        const auto WALL = Clock::now() - START;
+
+        EXPECT(ok, true);
+        std::cout << std::format("hotplug: {} add/remove cycles, {:.1f}us per cycle, {:.1f}us cpu per cycle\n", HOTPLUG_CYCLES, toUs(WALL) / HOTPLUG_CYCLES,
+                                 (cpuSeconds() - CPU) * 1000000.0 / HOTPLUG_CYCLES);
+    }
+
+    // input bursts
+    {
+        MockTab::pushKey(30, true);
+        MockTab::pushKey(30, false);
+        runUntil([] { return g_inputEvents >= 2; });
+
+        g_inputEvents    = 0;
+        const auto CPU   = cpuSeconds();
+        const auto START = Clock::now();
+
+        for (size_t sent = 0; sent < INPUT_EVENTS; sent += INPUT_BURST) {
+            for (size_t i = 0; i < INPUT_BURST; ++i) {
+                MockTab::pushPointerMotion(1.0, -1.0);
+            }
+
+            const size_t EXPECTED = sent + INPUT_BURST;
+            runUntil([EXPECTED] { return g_inputEvents >= EXPECTED; });
+        }
+
+        const auto WALL = std::chrono::duration<double>(Clock::now() - START).count();
+
+        EXPECT(g_inputEvents, INPUT_EVENTS);
+        std::cout << std::format("input: {} events in bursts of {}, {:.0f} events/s, {:.3f}us cpu per event\n", g_inputEvents, INPUT_BURST, g_inputEvents / WALL,
+                                 (cpuSeconds() - CPU) * 1000000.0 / std::max<size_t>(g_inputEvents, 1));
+    }
+
+    g_outputs.clear();
+    g_fds.clear();
+    g_backend.reset();
+
+    return ret;
+}